@@ -10,28 +10,234 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// load_xdf_many
+List load_xdf_many(CharacterVector filenames, Rcpp::Nullable<Rcpp::NumericVector> stream_ids, Rcpp::Nullable<Rcpp::NumericVector> target_rate, std::string quality, Rcpp::Nullable<Rcpp::List> resample_options, bool dejitter, int threads, int max_in_flight);
+RcppExport SEXP _rxdf_load_xdf_many(SEXP filenamesSEXP, SEXP stream_idsSEXP, SEXP target_rateSEXP, SEXP qualitySEXP, SEXP resample_optionsSEXP, SEXP dejitterSEXP, SEXP threadsSEXP, SEXP max_in_flightSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type filenames(filenamesSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericVector> >::type stream_ids(stream_idsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericVector> >::type target_rate(target_rateSEXP);
+    Rcpp::traits::input_parameter< std::string >::type quality(qualitySEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::List> >::type resample_options(resample_optionsSEXP);
+    Rcpp::traits::input_parameter< bool >::type dejitter(dejitterSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type max_in_flight(max_in_flightSEXP);
+    rcpp_result_gen = Rcpp::wrap(load_xdf_many(filenames, stream_ids, target_rate, quality, resample_options, dejitter, threads, max_in_flight));
+    return rcpp_result_gen;
+END_RCPP
+}
+// epoch
+NumericVector epoch(List stream, NumericVector events, double tmin, double tmax, Rcpp::Nullable<Rcpp::NumericVector> baseline);
+RcppExport SEXP _rxdf_epoch(SEXP streamSEXP, SEXP eventsSEXP, SEXP tminSEXP, SEXP tmaxSEXP, SEXP baselineSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type stream(streamSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type events(eventsSEXP);
+    Rcpp::traits::input_parameter< double >::type tmin(tminSEXP);
+    Rcpp::traits::input_parameter< double >::type tmax(tmaxSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericVector> >::type baseline(baselineSEXP);
+    rcpp_result_gen = Rcpp::wrap(epoch(stream, events, tmin, tmax, baseline));
+    return rcpp_result_gen;
+END_RCPP
+}
+// erp_average
+List erp_average(List stream, NumericVector events, IntegerVector conditions, double tmin, double tmax, Rcpp::Nullable<Rcpp::NumericVector> baseline);
+RcppExport SEXP _rxdf_erp_average(SEXP streamSEXP, SEXP eventsSEXP, SEXP conditionsSEXP, SEXP tminSEXP, SEXP tmaxSEXP, SEXP baselineSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type stream(streamSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type events(eventsSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type conditions(conditionsSEXP);
+    Rcpp::traits::input_parameter< double >::type tmin(tminSEXP);
+    Rcpp::traits::input_parameter< double >::type tmax(tmaxSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericVector> >::type baseline(baselineSEXP);
+    rcpp_result_gen = Rcpp::wrap(erp_average(stream, events, conditions, tmin, tmax, baseline));
+    return rcpp_result_gen;
+END_RCPP
+}
+// json_fields
+DataFrame json_fields(CharacterVector x, CharacterVector fields);
+RcppExport SEXP _rxdf_json_fields(SEXP xSEXP, SEXP fieldsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type fields(fieldsSEXP);
+    rcpp_result_gen = Rcpp::wrap(json_fields(x, fields));
+    return rcpp_result_gen;
+END_RCPP
+}
 // load_xdf
-List load_xdf(Rcpp::String filename_, Rcpp::Nullable<Rcpp::NumericVector> stream_ids);
-RcppExport SEXP _rxdf_load_xdf(SEXP filename_SEXP, SEXP stream_idsSEXP) {
+List load_xdf(Rcpp::String filename_, Rcpp::Nullable<Rcpp::NumericVector> stream_ids, Rcpp::Nullable<Rcpp::NumericVector> target_rate, std::string quality, Rcpp::Nullable<Rcpp::List> resample_options, bool dejitter, bool lazy);
+RcppExport SEXP _rxdf_load_xdf(SEXP filename_SEXP, SEXP stream_idsSEXP, SEXP target_rateSEXP, SEXP qualitySEXP, SEXP resample_optionsSEXP, SEXP dejitterSEXP, SEXP lazySEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< Rcpp::String >::type filename_(filename_SEXP);
     Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericVector> >::type stream_ids(stream_idsSEXP);
-    rcpp_result_gen = Rcpp::wrap(load_xdf(filename_, stream_ids));
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericVector> >::type target_rate(target_rateSEXP);
+    Rcpp::traits::input_parameter< std::string >::type quality(qualitySEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::List> >::type resample_options(resample_optionsSEXP);
+    Rcpp::traits::input_parameter< bool >::type dejitter(dejitterSEXP);
+    Rcpp::traits::input_parameter< bool >::type lazy(lazySEXP);
+    rcpp_result_gen = Rcpp::wrap(load_xdf(filename_, stream_ids, target_rate, quality, resample_options, dejitter, lazy));
+    return rcpp_result_gen;
+END_RCPP
+}
+// time_to_index
+IntegerVector time_to_index(NumericVector time_stamps, NumericVector times, std::string method);
+RcppExport SEXP _rxdf_time_to_index(SEXP time_stampsSEXP, SEXP timesSEXP, SEXP methodSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type time_stamps(time_stampsSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type times(timesSEXP);
+    Rcpp::traits::input_parameter< std::string >::type method(methodSEXP);
+    rcpp_result_gen = Rcpp::wrap(time_to_index(time_stamps, times, method));
+    return rcpp_result_gen;
+END_RCPP
+}
+// xdf_open
+SEXP xdf_open(Rcpp::String filename_, Rcpp::Nullable<Rcpp::NumericVector> target_rate, std::string quality, Rcpp::Nullable<Rcpp::List> resample_options, bool dejitter);
+RcppExport SEXP _rxdf_xdf_open(SEXP filename_SEXP, SEXP target_rateSEXP, SEXP qualitySEXP, SEXP resample_optionsSEXP, SEXP dejitterSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::String >::type filename_(filename_SEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericVector> >::type target_rate(target_rateSEXP);
+    Rcpp::traits::input_parameter< std::string >::type quality(qualitySEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::List> >::type resample_options(resample_optionsSEXP);
+    Rcpp::traits::input_parameter< bool >::type dejitter(dejitterSEXP);
+    rcpp_result_gen = Rcpp::wrap(xdf_open(filename_, target_rate, quality, resample_options, dejitter));
+    return rcpp_result_gen;
+END_RCPP
+}
+// xdf_streams
+DataFrame xdf_streams(SEXP handle);
+RcppExport SEXP _rxdf_xdf_streams(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(xdf_streams(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// xdf_stream
+List xdf_stream(SEXP handle, int stream_id);
+RcppExport SEXP _rxdf_xdf_stream(SEXP handleSEXP, SEXP stream_idSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< int >::type stream_id(stream_idSEXP);
+    rcpp_result_gen = Rcpp::wrap(xdf_stream(handle, stream_id));
+    return rcpp_result_gen;
+END_RCPP
+}
+// xdf_window
+List xdf_window(SEXP handle, int stream_id, double tmin, double tmax);
+RcppExport SEXP _rxdf_xdf_window(SEXP handleSEXP, SEXP stream_idSEXP, SEXP tminSEXP, SEXP tmaxSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< int >::type stream_id(stream_idSEXP);
+    Rcpp::traits::input_parameter< double >::type tmin(tminSEXP);
+    Rcpp::traits::input_parameter< double >::type tmax(tmaxSEXP);
+    rcpp_result_gen = Rcpp::wrap(xdf_window(handle, stream_id, tmin, tmax));
+    return rcpp_result_gen;
+END_RCPP
+}
+// xdf_time_to_index
+IntegerVector xdf_time_to_index(SEXP handle, int stream_id, NumericVector times, std::string method);
+RcppExport SEXP _rxdf_xdf_time_to_index(SEXP handleSEXP, SEXP stream_idSEXP, SEXP timesSEXP, SEXP methodSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< int >::type stream_id(stream_idSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type times(timesSEXP);
+    Rcpp::traits::input_parameter< std::string >::type method(methodSEXP);
+    rcpp_result_gen = Rcpp::wrap(xdf_time_to_index(handle, stream_id, times, method));
+    return rcpp_result_gen;
+END_RCPP
+}
+// xdf_resample
+SEXP xdf_resample(SEXP handle, int target_rate, std::string quality, Rcpp::Nullable<Rcpp::List> resample_options);
+RcppExport SEXP _rxdf_xdf_resample(SEXP handleSEXP, SEXP target_rateSEXP, SEXP qualitySEXP, SEXP resample_optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< int >::type target_rate(target_rateSEXP);
+    Rcpp::traits::input_parameter< std::string >::type quality(qualitySEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::List> >::type resample_options(resample_optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(xdf_resample(handle, target_rate, quality, resample_options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// xdf_epoch
+NumericVector xdf_epoch(SEXP handle, int stream_id, NumericVector events, double tmin, double tmax, Rcpp::Nullable<Rcpp::NumericVector> baseline);
+RcppExport SEXP _rxdf_xdf_epoch(SEXP handleSEXP, SEXP stream_idSEXP, SEXP eventsSEXP, SEXP tminSEXP, SEXP tmaxSEXP, SEXP baselineSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< int >::type stream_id(stream_idSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type events(eventsSEXP);
+    Rcpp::traits::input_parameter< double >::type tmin(tminSEXP);
+    Rcpp::traits::input_parameter< double >::type tmax(tmaxSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericVector> >::type baseline(baselineSEXP);
+    rcpp_result_gen = Rcpp::wrap(xdf_epoch(handle, stream_id, events, tmin, tmax, baseline));
+    return rcpp_result_gen;
+END_RCPP
+}
+// xdf_json_fields
+DataFrame xdf_json_fields(SEXP handle, int stream_id, CharacterVector fields, int channel);
+RcppExport SEXP _rxdf_xdf_json_fields(SEXP handleSEXP, SEXP stream_idSEXP, SEXP fieldsSEXP, SEXP channelSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< int >::type stream_id(stream_idSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type fields(fieldsSEXP);
+    Rcpp::traits::input_parameter< int >::type channel(channelSEXP);
+    rcpp_result_gen = Rcpp::wrap(xdf_json_fields(handle, stream_id, fields, channel));
     return rcpp_result_gen;
 END_RCPP
 }
 
 RcppExport SEXP _rcpp_module_boot_stdVector();
+RcppExport SEXP _rcpp_module_boot_xdf_reader();
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_rxdf_load_xdf", (DL_FUNC) &_rxdf_load_xdf, 2},
+    {"_rxdf_load_xdf_many", (DL_FUNC) &_rxdf_load_xdf_many, 8},
+    {"_rxdf_epoch", (DL_FUNC) &_rxdf_epoch, 5},
+    {"_rxdf_erp_average", (DL_FUNC) &_rxdf_erp_average, 6},
+    {"_rxdf_json_fields", (DL_FUNC) &_rxdf_json_fields, 2},
+    {"_rxdf_load_xdf", (DL_FUNC) &_rxdf_load_xdf, 7},
+    {"_rxdf_time_to_index", (DL_FUNC) &_rxdf_time_to_index, 3},
+    {"_rxdf_xdf_open", (DL_FUNC) &_rxdf_xdf_open, 5},
+    {"_rxdf_xdf_streams", (DL_FUNC) &_rxdf_xdf_streams, 1},
+    {"_rxdf_xdf_stream", (DL_FUNC) &_rxdf_xdf_stream, 2},
+    {"_rxdf_xdf_window", (DL_FUNC) &_rxdf_xdf_window, 4},
+    {"_rxdf_xdf_time_to_index", (DL_FUNC) &_rxdf_xdf_time_to_index, 4},
+    {"_rxdf_xdf_resample", (DL_FUNC) &_rxdf_xdf_resample, 4},
+    {"_rxdf_xdf_epoch", (DL_FUNC) &_rxdf_xdf_epoch, 6},
+    {"_rxdf_xdf_json_fields", (DL_FUNC) &_rxdf_xdf_json_fields, 4},
     {"_rcpp_module_boot_stdVector", (DL_FUNC) &_rcpp_module_boot_stdVector, 0},
+    {"_rcpp_module_boot_xdf_reader", (DL_FUNC) &_rcpp_module_boot_xdf_reader, 0},
     {NULL, NULL, 0}
 };
 
+void init_lazy_columns(DllInfo* dll);
 RcppExport void R_init_rxdf(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    init_lazy_columns(dll);
 }
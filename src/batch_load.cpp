@@ -0,0 +1,201 @@
+/*
+ *  \file batch_load.cpp
+ * Loading of many XDF files on a pool of worker threads
+ */
+
+#include <Rcpp.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "xdf.h"
+#include "rxdf.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Rcpp;
+
+// A file decoded by a worker, waiting for the main thread
+struct LoadedFile {
+  std::unique_ptr<Xdf> xdf;
+  std::ostringstream log;     // messages of the loader, printed on the main thread
+  std::string error;
+  int status = 0;
+};
+
+// Workers only decode files into Xdf objects; every R call stays on the main
+// thread. At most `max_in_flight` files are decoded or waiting to be
+// converted at any time, which bounds the memory.
+class BatchLoad {
+public:
+  BatchLoad(std::vector<std::string> filenames, const Xdf::LoadOptions& options, int threads, int max_in_flight)
+    : filenames(std::move(filenames)), options(options), max_in_flight(max_in_flight), files(this->filenames.size()) {
+    for(int t = 0; t < threads; ++t) {
+      workers.emplace_back(&BatchLoad::work, this);
+    }
+  }
+
+  // also reached when the conversion throws or the user interrupts
+  ~BatchLoad() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cancelled = true;
+    }
+    slot_free.notify_all();
+    for(auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  BatchLoad(const BatchLoad&) = delete;
+  BatchLoad& operator=(const BatchLoad&) = delete;
+
+  // Index of the next decoded file, in completion order; checks for user
+  // interrupts while waiting
+  size_t wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(done.empty()) {
+      file_done.wait_for(lock, std::chrono::milliseconds(100));
+      if(done.empty()) {
+        lock.unlock();
+        Rcpp::checkUserInterrupt();
+        lock.lock();
+      }
+    }
+    size_t i = done.front();
+    done.pop();
+    return i;
+  }
+
+  LoadedFile& file(size_t i) {
+    return files[i];
+  }
+
+  // the file has been converted: free it and let a worker take the next one
+  void release(size_t i) {
+    files[i].xdf.reset();
+    files[i].log.str(std::string());
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --in_flight;
+    }
+    slot_free.notify_one();
+  }
+
+private:
+  void work() {
+#ifdef _OPENMP
+    // the files are the unit of parallelism, so each one is decoded on its worker alone
+    omp_set_num_threads(1);
+#endif
+    while(true) {
+      size_t i;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_free.wait(lock, [this] { return cancelled || next >= filenames.size() || in_flight < max_in_flight; });
+        if(cancelled || next >= filenames.size()) {
+          return;
+        }
+        i = next++;
+        ++in_flight;
+      }
+
+      LoadedFile& loaded = files[i];
+      try {
+        loaded.xdf.reset(new Xdf);
+        loaded.xdf->logStream = &loaded.log;
+        loaded.status = loaded.xdf->load_xdf(filenames[i], options);
+        loaded.xdf->freeUpTimeStamps();
+        loaded.xdf->logStream = nullptr;
+      } catch(const std::exception& e) {
+        loaded.error = e.what();
+        loaded.xdf.reset();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.push(i);
+      }
+      file_done.notify_one();
+    }
+  }
+
+  const std::vector<std::string> filenames;
+  const Xdf::LoadOptions options;
+  const int max_in_flight;
+  std::vector<LoadedFile> files;
+
+  std::mutex mutex;
+  std::condition_variable slot_free;
+  std::condition_variable file_done;
+  std::queue<size_t> done;
+  size_t next = 0;
+  int in_flight = 0;
+  bool cancelled = false;
+
+  std::vector<std::thread> workers;
+};
+
+// [[Rcpp::export]]
+List load_xdf_many(CharacterVector filenames, Rcpp::Nullable<Rcpp::NumericVector> stream_ids = R_NilValue,
+                   Rcpp::Nullable<Rcpp::NumericVector> target_rate = R_NilValue, std::string quality = "standard",
+                   Rcpp::Nullable<Rcpp::List> resample_options = R_NilValue, bool dejitter = true, int threads = 0,
+                   int max_in_flight = 0) {
+  const size_t n = filenames.size();
+  List out(n);
+  out.names() = filenames;
+  if(n == 0) {
+    return out;
+  }
+
+  if(threads <= 0) {
+    threads = std::max(1, (int)std::thread::hardware_concurrency());
+  }
+  threads = std::min<int>(threads, n);
+  if(max_in_flight <= 0) {
+    max_in_flight = 2 * threads;
+  }
+  // a worker holds its file until it is converted, so fewer slots than workers would leave some idle
+  threads = std::min(threads, max_in_flight);
+
+  Xdf::LoadOptions load_options = get_load_options(target_rate, quality, resample_options, dejitter);
+  std::vector<std::string> paths(n);
+  for(size_t i = 0; i < n; ++i) {
+    paths[i] = Rcpp::as<std::string>(filenames[i]);
+  }
+
+  // warnings may longjmp under options(warn = 2), so they are raised once the workers are joined
+  std::vector<std::string> failures;
+  {
+    BatchLoad batch(paths, load_options, threads, max_in_flight);
+    for(size_t k = 0; k < n; ++k) {
+      // each file is converted as soon as it is decoded, in whatever order they finish
+      size_t i = batch.wait();
+      LoadedFile& loaded = batch.file(i);
+      Rcpp::Rcout << loaded.log.str();
+
+      if(!loaded.error.empty()) {
+        failures.push_back("could not load '" + paths[i] + "': " + loaded.error);
+      } else if(loaded.status != 0) {
+        failures.push_back("could not load '" + paths[i] + "'");
+      } else {
+        out[i] = get_xdf(*loaded.xdf, stream_ids, nullptr);
+      }
+      batch.release(i);
+    }
+  }
+
+  for(const auto& failure : failures) {
+    Rcpp::warning("%s", failure);
+  }
+
+  return out;
+}
@@ -0,0 +1,306 @@
+/*
+ *  \file epoch.cpp
+ * Extraction of event-locked epochs from a stream
+ */
+
+#include <Rcpp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "xdf.h"
+#include "epoch.h"
+#include "rxdf.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace Rcpp;
+
+EpochWindows epoch_windows(const double* timeStamps, size_t nSamples, double srate, const double* events,
+                           size_t nEvents, double tmin, double tmax, const double* baselineWindow) {
+  EpochWindows windows;
+  windows.length = (size_t)std::llround((tmax - tmin) * srate) + 1;
+
+  if(baselineWindow) {
+    // clamped while still signed, so a window outside the epoch cannot wrap around
+    double first = std::max(0.0, std::round((baselineWindow[0] - tmin) * srate));
+    double last = std::min((double)windows.length - 1, std::round((baselineWindow[1] - tmin) * srate));
+    windows.baseline = first <= last;
+    if(windows.baseline) {
+      windows.baselineFirst = (size_t)first;
+      windows.baselineLast = (size_t)last;
+    }
+  }
+
+  // window starts, as one sorted-friendly batch lookup
+  std::vector<double> starts(nEvents);
+  for(size_t i = 0; i < nEvents; ++i) {
+    starts[i] = events[i] + tmin;
+  }
+  windows.starts.resize(nEvents);
+  Xdf::timeToIndex(timeStamps, nSamples, starts.data(), nEvents, Xdf::IndexMethod::Nearest, windows.starts.data());
+
+  for(size_t i = 0; i < nEvents; ++i) {
+    int64_t start = windows.starts[i];
+    // also rejects missing event times, for which the comparison is false
+    if(start < 0 || (size_t)start + windows.length > nSamples ||
+       !(std::abs(timeStamps[start] - starts[i]) <= 1 / srate)) {
+      windows.starts[i] = -1;
+    }
+  }
+
+  return windows;
+}
+
+void epoch_copy(const std::vector<const double*>& channels, const EpochWindows& windows, double missing,
+                double* out) {
+  const size_t nChannels = channels.size();
+  const size_t length = windows.length;
+  const int nTrials = (int)windows.starts.size();
+
+#pragma omp parallel for schedule(static)
+  for(int trial = 0; trial < nTrials; ++trial) {
+    double* dest = out + (size_t)trial * nChannels * length;
+    const int64_t start = windows.starts[trial];
+
+    if(start < 0) {
+      std::fill(dest, dest + nChannels * length, missing);
+      continue;
+    }
+
+    for(size_t c = 0; c < nChannels; ++c, dest += length) {
+      std::memcpy(dest, channels[c] + start, length * sizeof(double));
+
+      if(windows.baseline) {
+        double sum = 0;
+        for(size_t k = windows.baselineFirst; k <= windows.baselineLast; ++k) {
+          sum += dest[k];
+        }
+        const double mean = sum / (double)(windows.baselineLast - windows.baselineFirst + 1);
+        for(size_t k = 0; k < length; ++k) {
+          dest[k] -= mean;
+        }
+      }
+    }
+  }
+}
+
+// Add one baseline-corrected window to the running sum and sum of squares
+static void accumulate_window(const double* src, size_t length, double offset, double* sum, double* squares) {
+  size_t k = 0;
+#ifdef __SSE2__
+  const __m128d shift = _mm_set1_pd(offset);
+  for(; k + 1 < length; k += 2) {
+    __m128d x = _mm_sub_pd(_mm_loadu_pd(src + k), shift);
+    _mm_storeu_pd(sum + k, _mm_add_pd(_mm_loadu_pd(sum + k), x));
+    _mm_storeu_pd(squares + k, _mm_add_pd(_mm_loadu_pd(squares + k), _mm_mul_pd(x, x)));
+  }
+#endif
+  for(; k < length; ++k) {
+    double x = src[k] - offset;
+    sum[k] += x;
+    squares[k] += x * x;
+  }
+}
+
+void erp_accumulate(const std::vector<const double*>& channels, const EpochWindows& windows, const int* conditions,
+                    size_t nConditions, double* sums, double* squares, int64_t* counts) {
+  const size_t nChannels = channels.size();
+  const size_t length = windows.length;
+  const size_t nTrials = windows.starts.size();
+
+  std::fill(sums, sums + nConditions * nChannels * length, 0.0);
+  std::fill(squares, squares + nConditions * nChannels * length, 0.0);
+  std::fill(counts, counts + nConditions, 0);
+  for(size_t trial = 0; trial < nTrials; ++trial) {
+    if(windows.starts[trial] >= 0 && conditions[trial] >= 0) {
+      counts[conditions[trial]]++;
+    }
+  }
+
+  // each thread owns whole channels, so the sums need no synchronization
+#pragma omp parallel for schedule(dynamic)
+  for(int c = 0; c < (int)nChannels; ++c) {
+    for(size_t trial = 0; trial < nTrials; ++trial) {
+      const int64_t start = windows.starts[trial];
+      const int condition = conditions[trial];
+      if(start < 0 || condition < 0) {
+        continue;
+      }
+
+      const double* src = channels[c] + start;
+      double offset = 0;
+      if(windows.baseline) {
+        for(size_t k = windows.baselineFirst; k <= windows.baselineLast; ++k) {
+          offset += src[k];
+        }
+        offset /= (double)(windows.baselineLast - windows.baselineFirst + 1);
+      }
+
+      const size_t at = ((size_t)condition * nChannels + c) * length;
+      accumulate_window(src, length, offset, sums + at, squares + at);
+    }
+  }
+}
+
+// Regular sample rate of a stream returned by load_xdf()
+static double stream_srate(List stream) {
+  List info = stream["info"];
+  double srate = Rcpp::as<double>(info["nominal_srate"]);
+  if(srate <= 0) {
+    Rcpp::stop("epochs need a stream with a regular sample rate");
+  }
+  return srate;
+}
+
+// Data channels of a stream as double columns, integer channels converted once; returns their names
+static CharacterVector stream_channels(List stream, std::vector<NumericVector>& columns) {
+  DataFrame time_series = stream["time_series"];
+  CharacterVector names = time_series.names();
+  CharacterVector channel_names;
+  for(R_xlen_t j = 0; j < time_series.size(); ++j) {
+    if(names[j] == "time_stamp") {
+      continue;
+    }
+    SEXP column = time_series[j];
+    if(TYPEOF(column) != REALSXP && TYPEOF(column) != INTSXP) {
+      Rcpp::stop("epochs need a numeric stream, column '%s' is not numeric", std::string(names[j]));
+    }
+    columns.push_back(Rcpp::as<NumericVector>(column));
+    channel_names.push_back(names[j]);
+  }
+  return channel_names;
+}
+
+// Sample windows of the events, with the optional c(start, end) baseline
+EpochWindows sample_windows(const double* time_stamps, size_t n_samples, double srate, NumericVector events,
+                            double tmin, double tmax, Rcpp::Nullable<Rcpp::NumericVector> baseline) {
+  if(tmax < tmin) {
+    Rcpp::stop("tmax must not be smaller than tmin");
+  }
+
+  std::vector<double> baseline_window;
+  if(baseline.isNotNull()) {
+    NumericVector window(baseline);
+    if(window.size() != 2) {
+      Rcpp::stop("baseline must be c(start, end) in seconds relative to the event");
+    }
+    if(!(tmin <= window[0] && window[0] <= window[1] && window[1] <= tmax)) {
+      Rcpp::stop("baseline must lie within the epoch: tmin <= start <= end <= tmax");
+    }
+    baseline_window.assign(window.begin(), window.end());
+  }
+
+  return epoch_windows(time_stamps, n_samples, srate, events.begin(), events.size(), tmin, tmax,
+                       baseline_window.empty() ? nullptr : baseline_window.data());
+}
+
+static NumericVector window_times(double tmin, double srate, size_t length) {
+  NumericVector times(length);
+  for(size_t k = 0; k < length; ++k) {
+    times[k] = tmin + k / srate;
+  }
+  return times;
+}
+
+NumericVector epoch_array(const std::vector<const double*>& channels, CharacterVector channel_names,
+                          const EpochWindows& windows, double tmin, double srate) {
+  NumericVector out(Dimension(windows.length, channels.size(), windows.starts.size()));
+  epoch_copy(channels, windows, NA_REAL, out.begin());
+
+  out.attr("dimnames") = List::create(R_NilValue, channel_names, R_NilValue);
+  out.attr("times") = window_times(tmin, srate, windows.length);
+
+  return out;
+}
+
+// [[Rcpp::export]]
+NumericVector epoch(List stream, NumericVector events, double tmin, double tmax,
+                    Rcpp::Nullable<Rcpp::NumericVector> baseline = R_NilValue) {
+  double srate = stream_srate(stream);
+  std::vector<NumericVector> columns;
+  CharacterVector channel_names = stream_channels(stream, columns);
+
+  std::vector<const double*> channels;
+  for(auto& column : columns) {
+    channels.push_back(column.begin());
+  }
+
+  NumericVector time_stamps = stream["time_stamps"];
+  EpochWindows windows = sample_windows(time_stamps.begin(), time_stamps.size(), srate, events, tmin, tmax,
+                                        baseline);
+  return epoch_array(channels, channel_names, windows, tmin, srate);
+}
+
+// [[Rcpp::export]]
+List erp_average(List stream, NumericVector events, IntegerVector conditions, double tmin, double tmax,
+                 Rcpp::Nullable<Rcpp::NumericVector> baseline = R_NilValue) {
+  if(conditions.size() != events.size()) {
+    Rcpp::stop("conditions must have one value per event");
+  }
+
+  double srate = stream_srate(stream);
+  std::vector<NumericVector> columns;
+  CharacterVector channel_names = stream_channels(stream, columns);
+  NumericVector time_stamps = stream["time_stamps"];
+  EpochWindows windows = sample_windows(time_stamps.begin(), time_stamps.size(), srate, events, tmin, tmax,
+                                        baseline);
+
+  std::vector<const double*> channels;
+  for(auto& column : columns) {
+    channels.push_back(column.begin());
+  }
+
+  // conditions are factor codes or 1-based integers; NA skips the event
+  CharacterVector condition_names;
+  if(conditions.hasAttribute("levels")) {
+    condition_names = conditions.attr("levels");
+  } else {
+    int max_code = 0;
+    for(int code : conditions) {
+      if(code != NA_INTEGER) max_code = std::max(max_code, code);
+    }
+    for(int code = 1; code <= max_code; ++code) {
+      condition_names.push_back(std::to_string(code));
+    }
+  }
+  const size_t n_conditions = condition_names.size();
+  std::vector<int> codes(conditions.size());
+  for(R_xlen_t i = 0; i < conditions.size(); ++i) {
+    int code = conditions[i];
+    codes[i] = (code == NA_INTEGER || code < 1 || code > (int)n_conditions) ? -1 : code - 1;
+  }
+
+  // the running sums are written straight into the arrays returned to R
+  NumericVector mean(Dimension(windows.length, channels.size(), n_conditions));
+  NumericVector variance(Dimension(windows.length, channels.size(), n_conditions));
+  std::vector<int64_t> counts(n_conditions);
+  erp_accumulate(channels, windows, codes.data(), n_conditions, mean.begin(), variance.begin(), counts.data());
+
+  const size_t block = windows.length * channels.size();
+  for(size_t c = 0; c < n_conditions; ++c) {
+    const double n = (double)counts[c];
+    for(size_t k = c * block; k < (c + 1) * block; ++k) {
+      const double sum = mean[k];
+      mean[k] = n > 0 ? sum / n : NA_REAL;
+      variance[k] = n > 1 ? (variance[k] - sum * mean[k]) / (n - 1) : NA_REAL;
+    }
+  }
+
+  List dimnames = List::create(R_NilValue, channel_names, condition_names);
+  mean.attr("dimnames") = dimnames;
+  variance.attr("dimnames") = dimnames;
+  IntegerVector count(counts.begin(), counts.end());
+  count.names() = condition_names;
+
+  return List::create(
+    Named("mean") = mean,
+    Named("variance") = variance,
+    Named("count") = count,
+    Named("times") = window_times(tmin, srate, windows.length)
+  );
+}
@@ -0,0 +1,63 @@
+/*
+ *  \file epoch.h
+ * Extraction of event-locked epochs from a stream
+ */
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*!
+ * \brief Sample window of every trial of an epoch extraction.
+ */
+struct EpochWindows
+{
+    size_t length = 0;              /*!< Samples per epoch. */
+    std::vector<int64_t> starts;    /*!< First sample of each trial, -1 if the window is not in the data. */
+    size_t baselineFirst = 0;       /*!< First baseline sample, relative to the window start. */
+    size_t baselineLast = 0;        /*!< Last baseline sample (inclusive), relative to the window start. */
+    bool baseline = false;          /*!< Whether to subtract the baseline mean. */
+};
+
+/*!
+ * \brief Find the sample window of each event.
+ *
+ * Each window starts at the sample nearest to `event + tmin` and spans
+ * `round((tmax - tmin) * srate) + 1` samples. Trials whose start is more
+ * than one sample interval away from `event + tmin`, or whose window does
+ * not fit in the data, get a start of -1.
+ * \param baselineWindow is `{start, end}` in seconds relative to the event,
+ * or nullptr for no baseline correction. It is clipped to the window, and
+ * there is no correction when nothing of it is left.
+ */
+EpochWindows epoch_windows(const double* timeStamps, size_t nSamples, double srate, const double* events,
+                           size_t nEvents, double tmin, double tmax, const double* baselineWindow);
+
+/*!
+ * \brief Copy the epochs of all channels into `out`.
+ *
+ * `out` is laid out trials x channels x samples in C order, which is an R
+ * array of dim c(samples, channels, trials). Each channel run of a trial is
+ * one memcpy, followed by the baseline correction while it is in cache.
+ * Trials with no window are filled with `missing`. Trials run in parallel.
+ */
+void epoch_copy(const std::vector<const double*>& channels, const EpochWindows& windows, double missing,
+                double* out);
+
+/*!
+ * \brief Accumulate the epochs of each condition without storing them.
+ *
+ * `sums` and `squares` receive, per condition, the sum and the sum of squares
+ * of the baseline-corrected epochs, laid out conditions x channels x samples
+ * in C order; `counts` receives the number of trials of each condition.
+ * Memory is one epoch per condition, whatever the number of trials. Channels
+ * run in parallel and the sums are accumulated with SSE2 when available.
+ * \param conditions holds the 0-based condition of each trial, -1 to skip it.
+ */
+void erp_accumulate(const std::vector<const double*>& channels, const EpochWindows& windows, const int* conditions,
+                    size_t nConditions, double* sums, double* squares, int64_t* counts);
+
+#endif // EPOCH_H
@@ -47,64 +47,27 @@ double basic_filter(const double* SMARC_RESTRICT filt, const double* SMARC_RESTR
 	return v;
 }
 
-double sse_filtering_aligned(const double* SMARC_RESTRICT filt, const double* SMARC_RESTRICT signal, const int K) {
-//	printf("sse_filtering filt=%p signal=%p K=%i\n",filt,signal,K);
-	// filt and signal are 16 byte aligned, K % 2 = 0
-	__m128d v = _mm_setzero_pd();
-	int k=0;
-	for (;k<K-1;k+=2) {
-		__m128d f = _mm_load_pd(filt + k);
-		__m128d s = _mm_load_pd(signal + k);
-		v = _mm_add_pd(v,_mm_mul_pd(f,s));
-	}
-	double tmp[2];
-	_mm_storeu_pd(tmp,v);
-	if (k==K)
-		return tmp[0] + tmp[1];
-	// else
-	return tmp[0] + tmp[1] + filt[k]*signal[k];
-}
-
-double sse_filtering_misaligned(const double* SMARC_RESTRICT filt, const double* SMARC_RESTRICT signal, const int K) {
-//	printf("sse_filtering_misaligned filt=%p signal=%p K=%i\n",filt,signal,K);
-	__m128d v = _mm_setzero_pd();
-	__m128d s = _mm_load1_pd(signal);
+double filter(const double* SMARC_RESTRICT filt, const double* SMARC_RESTRICT signal, int K)
+{
+	if (K<8)
+		return basic_filter(filt,signal,K);
+	// unaligned loads: the summation order does not depend on the alignment of filt
+	// and signal, so a given window always gives exactly the same value wherever it
+	// sits in the stage buffers (smarc_resample_segmented relies on this)
+	__m128d v0 = _mm_setzero_pd();
+	__m128d v1 = _mm_setzero_pd();
 	int k=0;
-	for (;k<K-4;k+=4) {
-		__m128d f = _mm_load_pd(filt + k);
-		__m128d s2 = _mm_load_pd(signal + k + 1);
-		s = _mm_shuffle_pd(s,s2,_MM_SHUFFLE2(0,1));
-		v = _mm_add_pd(v,_mm_mul_pd(f,s));
-		f = _mm_load_pd(filt + k + 2);
-		s = _mm_load_pd(signal + k + 3);
-		s2 = _mm_shuffle_pd(s2,s,_MM_SHUFFLE2(0,1));
-		v = _mm_add_pd(v,_mm_mul_pd(f,s2));
+	for (;k<K-3;k+=4) {
+		v0 = _mm_add_pd(v0,_mm_mul_pd(_mm_loadu_pd(filt + k),_mm_loadu_pd(signal + k)));
+		v1 = _mm_add_pd(v1,_mm_mul_pd(_mm_loadu_pd(filt + k + 2),_mm_loadu_pd(signal + k + 2)));
 	}
 	double tmp[2];
-	_mm_storeu_pd(tmp,v);
+	_mm_storeu_pd(tmp,_mm_add_pd(v0,v1));
 	for (;k<K;++k)
 		tmp[0]+=filt[k]*signal[k];
 	return tmp[0] + tmp[1];
 }
 
-double filter(const double* SMARC_RESTRICT filt, const double* SMARC_RESTRICT signal, int K)
-{
-	if (K<8)
-		return basic_filter(filt,signal,K);
-	double v = 0;
-	if ((((unsigned long)filt) & 15) != 0) { // if filt is not 16-bytes aligned
-		v += filt[0]*signal[0];
-		++filt;
-		++signal;
-		--K;
-	}
-	if ((((unsigned long)signal) & 15) == 0) { // if signal is 16-bytes aligned
-		return v + sse_filtering_aligned(filt,signal,K);
-	}
-	// else
-	return v + sse_filtering_misaligned(filt,signal,K);
-}
-
 
 #endif
 
@@ -0,0 +1,94 @@
+/*
+ * Smarc
+ *
+ * Copyright (c) 2009-2011 Institut Télécom - Télécom Paristech
+ * Télécom ParisTech / dept. TSI
+ *
+ * Authors : Benoit Mathieu, Jacques Prado
+ *
+ * This file is part of Smarc.
+ *
+ * Smarc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Smarc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************************************
+ * Windowed-sinc lowpass design with a Kaiser window, see J.F. Kaiser,
+ * "Nonrecursive digital filter design using the I0-sinh window function" and
+ * A.V. Oppenheim, R.W. Schafer "Discrete-time signal processing", section 7.5.
+ * Unlike remez_lp the design is closed form: its cost is linear in the filter length.
+ ********************************************************************************/
+
+#include "kaiser_lp.h"
+#include "remez_lp.h"
+#include <math.h>
+
+/**
+ * Attenuation added to the design target: Kaiser's order estimate falls a
+ * few dB short of the requested stopband, the more so the higher it is
+ * (up to 3 dB at 140 dB).
+ */
+#define KAISER_MARGIN_DB 5.0
+
+/**
+ * Modified Bessel function of the first kind, order 0 (power series)
+ */
+double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	double q = x * x / 4.0;
+	for (int k=1;k<500;k++)
+	{
+		term *= q / ((double)k * k);
+		sum += term;
+		if (term < sum * 1e-16)
+			break;
+	}
+	return sum;
+}
+
+int kaiser_lp_order(const double* fcuts, const double* dev, double* beta)
+{
+	double delta = (dev[0] < dev[1] ? dev[0] : dev[1]);
+	double A = -20.0 * log10(delta) + KAISER_MARGIN_DB;
+	if (A > 50)
+		*beta = 0.1102 * (A - 8.7);
+	else if (A > 21)
+		*beta = 0.5842 * pow(A - 21, 0.4) + 0.07886 * (A - 21);
+	else
+		*beta = 0;
+	double df = fcuts[2] - fcuts[1];
+	return (int) ceil((A - 7.95) / (14.36 * df)) + 1;
+}
+
+void kaiser_lp(double h[], int filterLen, const double bands[], double beta)
+{
+	// cutoff in the middle of the transition band
+	double fc = (bands[1] + bands[2]) / 2;
+	double center = (filterLen - 1) / 2.0;
+	double i0beta = bessel_i0(beta);
+	double sum = 0.0;
+	for (int n=0;n<filterLen;n++)
+	{
+		double t = n - center;
+		double sinc = (t == 0) ? 2 * fc : sin(PI2 * fc * t) / (PI * t);
+		double r = (center > 0) ? t / center : 0;
+		double w = bessel_i0(beta * sqrt(1 - r * r)) / i0beta;
+		h[n] = sinc * w;
+		sum += h[n];
+	}
+	// normalize DC gain to unity
+	for (int n=0;n<filterLen;n++)
+		h[n] /= sum;
+}
@@ -0,0 +1,49 @@
+/*
+ * Smarc
+ *
+ * Copyright (c) 2009-2011 Institut Télécom - Télécom Paristech
+ * Télécom ParisTech / dept. TSI
+ *
+ * Authors : Benoit Mathieu, Jacques Prado
+ *
+ * This file is part of Smarc.
+ *
+ * Smarc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Smarc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KAISER_LP_H__
+#define __KAISER_LP_H__
+
+/**
+ * Compute minimal length of a Kaiser windowed-sinc lowpass filter for given parameters
+ * (Kaiser's empirical formula, designed for a few dB more than asked so that the
+ * stopband attenuation is met).
+ * - fcuts [IN]: frequency bands (normalized form). Should be [0 fpass fcut 0.5]
+ * - dev [IN]: accepted ripple factor in given bands. The window is designed for the smallest one.
+ * - beta [OUT]: Kaiser window shape parameter to use in kaiser_lp
+ * return filter length.
+ */
+int kaiser_lp_order(const double* fcuts, const double* dev, double* beta);
+
+/**
+ * Build a windowed-sinc lowpass filter with a Kaiser window. This is a closed form design,
+ * it does not iterate and cannot fail to converge.
+ * - h [OUT]: array where to write result filter (already allocated)
+ * - filterLen [IN]: filter length (computed by kaiser_lp_order)
+ * - bands [IN]: frequency bands (normalized form). Should be [0 fpass fcut 0.5]
+ * - beta [IN]: window shape parameter computed by kaiser_lp_order
+ */
+void kaiser_lp(double h[], int filterLen, const double bands[], double beta);
+
+#endif /* __KAISER_LP_H__ */
@@ -0,0 +1,388 @@
+/*
+ *  \file lazy_columns.cpp
+ * Channel columns decoded on access from a memory-mapped XDF file, and time
+ * stamps expanded on access from their compact form
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <Rcpp.h>
+#include <R_ext/Altrep.h>
+#include <R_ext/Rdynload.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "xdf.h"
+#include "lazy_columns.h"
+#include "rxdf.h"
+
+using namespace Rcpp;
+
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& filename) {
+#ifdef _WIN32
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER file_size;
+    if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+      close();
+      Rcpp::stop("cannot map '%s'", filename);
+    }
+    length = (size_t)file_size.QuadPart;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mapping) {
+      bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if(fd < 0 || fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+      if(fd >= 0) ::close(fd);
+      Rcpp::stop("cannot map '%s'", filename);
+    }
+    length = (size_t)file_stat.st_size;
+    void* mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapped != MAP_FAILED) {
+      bytes = static_cast<const char*>(mapped);
+    }
+#endif
+    if(!bytes) {
+      close();
+      Rcpp::stop("cannot map '%s'", filename);
+    }
+  }
+
+  ~MappedFile() {
+    close();
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  void close() {
+#ifdef _WIN32
+    if(bytes) UnmapViewOfFile(bytes);
+    if(mapping) CloseHandle(mapping);
+    if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if(bytes) munmap(const_cast<char*>(bytes), length);
+#endif
+    bytes = nullptr;
+  }
+
+  const char* bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = NULL;
+#endif
+};
+
+std::shared_ptr<MappedFile> map_file(const std::string& filename) {
+  return std::make_shared<MappedFile>(filename);
+}
+
+// One channel of a lazily loaded stream. The last decoded chunk is kept, so
+// element-by-element reads decode each chunk once.
+struct LazyColumn {
+  std::shared_ptr<MappedFile> file;
+  std::shared_ptr<const std::vector<Xdf::SampleChunk>> chunks;
+  std::string format;
+  int channel_count;
+  int channel;
+  bool integer;               // an integer column, like the eager int formats
+  R_xlen_t length;
+
+  size_t cached = std::numeric_limits<size_t>::max();
+  std::vector<double> values;
+
+  // chunk holding sample i
+  size_t find(R_xlen_t i) const {
+    auto after = std::upper_bound(chunks->begin(), chunks->end(), (uint64_t)i,
+                                  [](uint64_t sample, const Xdf::SampleChunk& chunk) { return sample < chunk.first; });
+    return std::distance(chunks->begin(), after) - 1;
+  }
+
+  const std::vector<double>& decode(size_t c) {
+    if(c != cached) {
+      const Xdf::SampleChunk& chunk = (*chunks)[c];
+      values.resize(chunk.count);
+      Xdf::decodeChunk(file->data() + chunk.offset, chunk.count, channel_count, format, channel, values.data());
+      cached = c;
+    }
+    return values;
+  }
+
+  double at(R_xlen_t i) {
+    size_t c = find(i);
+    return decode(c)[i - (*chunks)[c].first];
+  }
+
+  // samples [first, first + n) into out; whole chunks are decoded straight into it
+  template <typename T>
+  void read(R_xlen_t first, R_xlen_t n, T* out) {
+    std::vector<double> buffer;
+    for(size_t c = find(first); n > 0; ++c) {
+      const Xdf::SampleChunk& chunk = (*chunks)[c];
+      R_xlen_t skip = first - chunk.first;
+      R_xlen_t take = std::min<R_xlen_t>(n, chunk.count - skip);
+      const double* source;
+      if(c == cached) {
+        source = values.data() + skip;
+      } else {
+        buffer.resize(chunk.count);
+        Xdf::decodeChunk(file->data() + chunk.offset, chunk.count, channel_count, format, channel, buffer.data());
+        source = buffer.data() + skip;
+      }
+      for(R_xlen_t k = 0; k < take; ++k) {
+        if constexpr (std::is_same_v<T, int>) {
+          out[k] = to_integer(source[k]);
+        } else {
+          out[k] = source[k];
+        }
+      }
+      out += take;
+      first += take;
+      n -= take;
+    }
+  }
+};
+
+static R_altrep_class_t lazy_real_class;
+static R_altrep_class_t lazy_integer_class;
+static R_altrep_class_t lazy_time_stamps_class;
+
+static LazyColumn* lazy_column(SEXP x) {
+  return static_cast<LazyColumn*>(R_ExternalPtrAddr(R_altrep_data1(x)));
+}
+
+static void lazy_finalize(SEXP ptr) {
+  delete static_cast<LazyColumn*>(R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+// the decoded vector, kept in data2 once built
+static SEXP lazy_materialize(SEXP x) {
+  SEXP data = R_altrep_data2(x);
+  if(data == R_NilValue) {
+    LazyColumn* column = lazy_column(x);
+    data = PROTECT(Rf_allocVector(column->integer ? INTSXP : REALSXP, column->length));
+    if(column->integer) {
+      column->read(0, column->length, INTEGER(data));
+    } else {
+      column->read(0, column->length, REAL(data));
+    }
+    R_set_altrep_data2(x, data);
+    UNPROTECT(1);
+  }
+  return data;
+}
+
+static R_xlen_t lazy_length(SEXP x) {
+  return lazy_column(x)->length;
+}
+
+static Rboolean lazy_inspect(SEXP x, int pre, int deep, int pvec, void (*inspect_subtree)(SEXP, int, int, int)) {
+  LazyColumn* column = lazy_column(x);
+  Rprintf(" lazy xdf column (channel %d of %d, %s, %s)\n", column->channel + 1, column->channel_count,
+          column->format.c_str(), R_altrep_data2(x) == R_NilValue ? "not decoded" : "decoded");
+  return TRUE;
+}
+
+// saved as the plain decoded vector
+static SEXP lazy_serialized_state(SEXP x) {
+  return lazy_materialize(x);
+}
+
+static SEXP lazy_unserialize(SEXP cls, SEXP state) {
+  return state;
+}
+
+static void* lazy_dataptr(SEXP x, Rboolean writeable) {
+  SEXP data = lazy_materialize(x);
+  return TYPEOF(data) == INTSXP ? (void*)INTEGER(data) : (void*)REAL(data);
+}
+
+static const void* lazy_dataptr_or_null(SEXP x) {
+  SEXP data = R_altrep_data2(x);
+  if(data == R_NilValue) {
+    return NULL;
+  }
+  return TYPEOF(data) == INTSXP ? (const void*)INTEGER(data) : (const void*)REAL(data);
+}
+
+static double lazy_real_elt(SEXP x, R_xlen_t i) {
+  SEXP data = R_altrep_data2(x);
+  return data == R_NilValue ? lazy_column(x)->at(i) : REAL(data)[i];
+}
+
+static int lazy_integer_elt(SEXP x, R_xlen_t i) {
+  SEXP data = R_altrep_data2(x);
+  return data == R_NilValue ? to_integer(lazy_column(x)->at(i)) : INTEGER(data)[i];
+}
+
+static R_xlen_t lazy_real_get_region(SEXP x, R_xlen_t i, R_xlen_t n, double* buf) {
+  LazyColumn* column = lazy_column(x);
+  n = std::min(n, column->length - i);
+  SEXP data = R_altrep_data2(x);
+  if(data == R_NilValue) {
+    column->read(i, n, buf);
+  } else {
+    std::memcpy(buf, REAL(data) + i, n * sizeof(double));
+  }
+  return n;
+}
+
+static R_xlen_t lazy_integer_get_region(SEXP x, R_xlen_t i, R_xlen_t n, int* buf) {
+  LazyColumn* column = lazy_column(x);
+  n = std::min(n, column->length - i);
+  SEXP data = R_altrep_data2(x);
+  if(data == R_NilValue) {
+    column->read(i, n, buf);
+  } else {
+    std::memcpy(buf, INTEGER(data) + i, n * sizeof(int));
+  }
+  return n;
+}
+
+// Time stamps kept in their compact form; the full vector is only expanded
+// when R asks for its data pointer
+static Xdf::CompactTimeStamps* lazy_stamps(SEXP x) {
+  return static_cast<Xdf::CompactTimeStamps*>(R_ExternalPtrAddr(R_altrep_data1(x)));
+}
+
+static void lazy_stamps_finalize(SEXP ptr) {
+  delete static_cast<Xdf::CompactTimeStamps*>(R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+static SEXP lazy_stamps_materialize(SEXP x) {
+  SEXP data = R_altrep_data2(x);
+  if(data == R_NilValue) {
+    const Xdf::CompactTimeStamps* stamps = lazy_stamps(x);
+    data = PROTECT(Rf_allocVector(REALSXP, stamps->size()));
+    stamps->expand(REAL(data));
+    R_set_altrep_data2(x, data);
+    UNPROTECT(1);
+  }
+  return data;
+}
+
+static R_xlen_t lazy_stamps_length(SEXP x) {
+  return lazy_stamps(x)->size();
+}
+
+static Rboolean lazy_stamps_inspect(SEXP x, int pre, int deep, int pvec, void (*inspect_subtree)(SEXP, int, int, int)) {
+  const Xdf::CompactTimeStamps* stamps = lazy_stamps(x);
+  Rprintf(" compact xdf time stamps (%d segments, %d exceptions, %s)\n", (int)stamps->segments.size(),
+          (int)stamps->exceptions.size(), R_altrep_data2(x) == R_NilValue ? "not expanded" : "expanded");
+  return TRUE;
+}
+
+static SEXP lazy_stamps_serialized_state(SEXP x) {
+  return lazy_stamps_materialize(x);
+}
+
+static void* lazy_stamps_dataptr(SEXP x, Rboolean writeable) {
+  return REAL(lazy_stamps_materialize(x));
+}
+
+static double lazy_stamps_elt(SEXP x, R_xlen_t i) {
+  SEXP data = R_altrep_data2(x);
+  return data == R_NilValue ? lazy_stamps(x)->at(i) : REAL(data)[i];
+}
+
+static R_xlen_t lazy_stamps_get_region(SEXP x, R_xlen_t i, R_xlen_t n, double* buf) {
+  n = std::min(n, lazy_stamps_length(x) - i);
+  SEXP data = R_altrep_data2(x);
+  if(data == R_NilValue) {
+    const Xdf::CompactTimeStamps* stamps = lazy_stamps(x);
+    for(R_xlen_t k = 0; k < n; ++k) {
+      buf[k] = stamps->at(i + k);
+    }
+  } else {
+    std::memcpy(buf, REAL(data) + i, n * sizeof(double));
+  }
+  return n;
+}
+
+// [[Rcpp::init]]
+void init_lazy_columns(DllInfo* dll) {
+  lazy_real_class = R_make_altreal_class("lazy_real", "rxdf", dll);
+  R_set_altrep_Length_method(lazy_real_class, lazy_length);
+  R_set_altrep_Inspect_method(lazy_real_class, lazy_inspect);
+  R_set_altrep_Serialized_state_method(lazy_real_class, lazy_serialized_state);
+  R_set_altrep_Unserialize_method(lazy_real_class, lazy_unserialize);
+  R_set_altvec_Dataptr_method(lazy_real_class, lazy_dataptr);
+  R_set_altvec_Dataptr_or_null_method(lazy_real_class, lazy_dataptr_or_null);
+  R_set_altreal_Elt_method(lazy_real_class, lazy_real_elt);
+  R_set_altreal_Get_region_method(lazy_real_class, lazy_real_get_region);
+
+  lazy_integer_class = R_make_altinteger_class("lazy_integer", "rxdf", dll);
+  R_set_altrep_Length_method(lazy_integer_class, lazy_length);
+  R_set_altrep_Inspect_method(lazy_integer_class, lazy_inspect);
+  R_set_altrep_Serialized_state_method(lazy_integer_class, lazy_serialized_state);
+  R_set_altrep_Unserialize_method(lazy_integer_class, lazy_unserialize);
+  R_set_altvec_Dataptr_method(lazy_integer_class, lazy_dataptr);
+  R_set_altvec_Dataptr_or_null_method(lazy_integer_class, lazy_dataptr_or_null);
+  R_set_altinteger_Elt_method(lazy_integer_class, lazy_integer_elt);
+  R_set_altinteger_Get_region_method(lazy_integer_class, lazy_integer_get_region);
+
+  lazy_time_stamps_class = R_make_altreal_class("lazy_time_stamps", "rxdf", dll);
+  R_set_altrep_Length_method(lazy_time_stamps_class, lazy_stamps_length);
+  R_set_altrep_Inspect_method(lazy_time_stamps_class, lazy_stamps_inspect);
+  R_set_altrep_Serialized_state_method(lazy_time_stamps_class, lazy_stamps_serialized_state);
+  R_set_altrep_Unserialize_method(lazy_time_stamps_class, lazy_unserialize);
+  R_set_altvec_Dataptr_method(lazy_time_stamps_class, lazy_stamps_dataptr);
+  R_set_altvec_Dataptr_or_null_method(lazy_time_stamps_class, lazy_dataptr_or_null);
+  R_set_altreal_Elt_method(lazy_time_stamps_class, lazy_stamps_elt);
+  R_set_altreal_Get_region_method(lazy_time_stamps_class, lazy_stamps_get_region);
+}
+
+DataFrame get_lazy_timeseries(const std::shared_ptr<MappedFile>& file, const Xdf::Stream& stream) {
+  auto chunks = std::make_shared<const std::vector<Xdf::SampleChunk>>(stream.sample_chunks);
+  const Xdf::SampleChunk& last = chunks->back();
+  const std::string& format = stream.info.channel_format;
+  const bool integer = format.compare("float32") && format.compare("double64");
+
+  const R_xlen_t length = (R_xlen_t)(last.first + last.count);
+  List columns(stream.info.channel_count);
+  CharacterVector names(stream.info.channel_count);
+  for(int v = 0; v < stream.info.channel_count; ++v) {
+    LazyColumn* column = new LazyColumn{ file, chunks, format, stream.info.channel_count, v, integer, length };
+    SEXP ptr = PROTECT(R_MakeExternalPtr(column, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ptr, lazy_finalize, TRUE);
+    columns[v] = R_new_altrep(integer ? lazy_integer_class : lazy_real_class, ptr, R_NilValue);
+    UNPROTECT(1);
+    names[v] = "V" + std::to_string(v + 1);
+  }
+
+  // nothing may go through as.data.frame(), or the columns would be decoded as soon as they are loaded
+  return new_data_frame(columns, names, length);
+}
+
+SEXP get_lazy_time_stamps(const Xdf::CompactTimeStamps& time_stamps) {
+  SEXP ptr = PROTECT(R_MakeExternalPtr(new Xdf::CompactTimeStamps(time_stamps), R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(ptr, lazy_stamps_finalize, TRUE);
+  SEXP out = R_new_altrep(lazy_time_stamps_class, ptr, R_NilValue);
+  UNPROTECT(1);
+  return out;
+}
@@ -0,0 +1,40 @@
+/*
+ *  \file lazy_columns.h
+ * Channel columns decoded on access from a memory-mapped XDF file, and time
+ * stamps expanded on access from their compact form
+ */
+
+#ifndef LAZY_COLUMNS_H
+#define LAZY_COLUMNS_H
+
+#include <Rcpp.h>
+#include <memory>
+#include <string>
+#include "xdf.h"
+
+class MappedFile;
+
+/*!
+ * \brief Map a whole file read-only; stops with an R error if it cannot.
+ */
+std::shared_ptr<MappedFile> map_file(const std::string& filename);
+
+/*!
+ * \brief Time series of a stream loaded with `LoadOptions::lazyValues`.
+ *
+ * Each channel is an ALTREP vector over `file`. Reading an element or a
+ * region decodes only the chunks it touches; asking for the data pointer
+ * decodes the whole channel once.
+ */
+Rcpp::DataFrame get_lazy_timeseries(const std::shared_ptr<MappedFile>& file, const Xdf::Stream& stream);
+
+/*!
+ * \brief Time stamps of a regular stream as an ALTREP vector over a copy of
+ * their compact form.
+ *
+ * Elements and regions are computed from the segments; the full vector is
+ * expanded once, when R asks for its data pointer.
+ */
+SEXP get_lazy_time_stamps(const Xdf::CompactTimeStamps& time_stamps);
+
+#endif // LAZY_COLUMNS_H
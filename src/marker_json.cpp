@@ -0,0 +1,332 @@
+/*
+ *  \file marker_json.cpp
+ * Extraction of fields from JSON marker payloads
+ */
+
+#include <Rcpp.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "marker_json.h"
+#include "rxdf.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Rcpp;
+
+// The scanner only looks at structure: it skips over values without decoding
+// them, and every function returns the position past what it read, or nullptr
+// when the payload is not valid JSON there.
+
+static const char* skip_space(const char* p, const char* end) {
+  while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+    ++p;
+  }
+  return p;
+}
+
+// p is at the opening quote
+static const char* skip_string(const char* p, const char* end) {
+  for(++p; p < end; ++p) {
+    if(*p == '\\') {
+      ++p;
+    } else if(*p == '"') {
+      return p + 1;
+    }
+  }
+  return nullptr;
+}
+
+static const char* skip_value(const char* p, const char* end) {
+  if(p >= end) {
+    return nullptr;
+  }
+  if(*p == '"') {
+    return skip_string(p, end);
+  }
+  if(*p == '{' || *p == '[') {
+    int depth = 0;
+    while(p < end) {
+      if(*p == '"') {
+        p = skip_string(p, end);
+        if(!p) return nullptr;
+        continue;
+      }
+      if(*p == '{' || *p == '[') {
+        ++depth;
+      } else if((*p == '}' || *p == ']') && --depth == 0) {
+        return p + 1;
+      }
+      ++p;
+    }
+    return nullptr;
+  }
+  // number or literal
+  const char* q = p;
+  while(q < end && *q != ',' && *q != '}' && *q != ']' && *q != ' ' && *q != '\t' && *q != '\n' && *q != '\r') {
+    ++q;
+  }
+  return q == p ? nullptr : q;
+}
+
+// p is at '{'; returns the value of the member named key
+static const char* find_member(const char* p, const char* end, const std::string& key) {
+  p = skip_space(p + 1, end);
+  while(p < end && *p == '"') {
+    const char* key_end = skip_string(p, end);
+    if(!key_end) return nullptr;
+    // keys are compared as written, escapes included
+    bool match = (size_t)(key_end - p - 2) == key.size() && std::memcmp(p + 1, key.data(), key.size()) == 0;
+    p = skip_space(key_end, end);
+    if(p >= end || *p != ':') return nullptr;
+    p = skip_space(p + 1, end);
+    if(match) return p;
+    p = skip_value(p, end);
+    if(!p) return nullptr;
+    p = skip_space(p, end);
+    if(p >= end || *p != ',') return nullptr;
+    p = skip_space(p + 1, end);
+  }
+  return nullptr;
+}
+
+// p is at '['; returns element index
+static const char* find_element(const char* p, const char* end, size_t index) {
+  p = skip_space(p + 1, end);
+  for(size_t i = 0; p < end && *p != ']'; ++i) {
+    if(i == index) return p;
+    p = skip_value(p, end);
+    if(!p) return nullptr;
+    p = skip_space(p, end);
+    if(p >= end || *p != ',') return nullptr;
+    p = skip_space(p + 1, end);
+  }
+  return nullptr;
+}
+
+static bool is_index(const std::string& key) {
+  return !key.empty() && key.find_first_not_of("0123456789") == std::string::npos;
+}
+
+static JsonValue read_value(const char* p, const char* end) {
+  JsonValue value;
+  const char* value_end = skip_value(p, end);
+  if(!value_end) {
+    return value;
+  }
+
+  value.begin = p;
+  value.length = value_end - p;
+  switch(*p) {
+  case '"':
+    value.kind = JsonKind::String;
+    value.begin = p + 1;
+    value.length -= 2;
+    break;
+  case '{':
+  case '[':
+    value.kind = JsonKind::Other;
+    break;
+  case 't':
+    value.kind = value.length == 4 && !std::memcmp(p, "true", 4) ? JsonKind::True : JsonKind::Other;
+    break;
+  case 'f':
+    value.kind = value.length == 5 && !std::memcmp(p, "false", 5) ? JsonKind::False : JsonKind::Other;
+    break;
+  case 'n':
+    value.kind = value.length == 4 && !std::memcmp(p, "null", 4) ? JsonKind::Null : JsonKind::Other;
+    break;
+  default: {
+    // payloads are not null-terminated, so the number is copied before strtod
+    char digits[64];
+    value.kind = JsonKind::Other;
+    if(value.length < sizeof(digits)) {
+      std::memcpy(digits, p, value.length);
+      digits[value.length] = '\0';
+      char* parsed;
+      value.number = std::strtod(digits, &parsed);
+      if(parsed == digits + value.length) {
+        value.kind = JsonKind::Number;
+      }
+    }
+  }
+  }
+  return value;
+}
+
+std::vector<std::string> json_path(const std::string& field) {
+  std::vector<std::string> keys;
+  size_t first = 0;
+  for(size_t dot = field.find('.'); dot != std::string::npos; dot = field.find('.', first)) {
+    keys.push_back(field.substr(first, dot - first));
+    first = dot + 1;
+  }
+  keys.push_back(field.substr(first));
+  return keys;
+}
+
+void json_extract(const std::vector<std::string_view>& payloads, const std::vector<std::vector<std::string>>& paths,
+                  JsonValue* out) {
+  const size_t n_paths = paths.size();
+
+#pragma omp parallel for schedule(static)
+  for(int i = 0; i < (int)payloads.size(); ++i) {
+    const char* begin = payloads[i].data();
+    const char* end = begin + payloads[i].size();
+    if(!begin) continue;
+    begin = skip_space(begin, end);
+
+    for(size_t f = 0; f < n_paths; ++f) {
+      const char* p = begin;
+      for(const auto& key : paths[f]) {
+        if(p < end && *p == '{') {
+          p = find_member(p, end, key);
+        } else if(p < end && *p == '[' && is_index(key)) {
+          p = find_element(p, end, std::strtoul(key.c_str(), nullptr, 10));
+        } else {
+          p = nullptr;
+        }
+        if(!p) break;
+      }
+      if(p) {
+        out[i * n_paths + f] = read_value(p, end);
+      }
+    }
+  }
+}
+
+static void append_utf8(unsigned long code, std::string& out) {
+  if(code < 0x80) {
+    out += (char)code;
+  } else if(code < 0x800) {
+    out += (char)(0xC0 | (code >> 6));
+    out += (char)(0x80 | (code & 0x3F));
+  } else if(code < 0x10000) {
+    out += (char)(0xE0 | (code >> 12));
+    out += (char)(0x80 | ((code >> 6) & 0x3F));
+    out += (char)(0x80 | (code & 0x3F));
+  } else {
+    out += (char)(0xF0 | (code >> 18));
+    out += (char)(0x80 | ((code >> 12) & 0x3F));
+    out += (char)(0x80 | ((code >> 6) & 0x3F));
+    out += (char)(0x80 | (code & 0x3F));
+  }
+}
+
+static unsigned long read_hex4(const char* p) {
+  char hex[5] = { p[0], p[1], p[2], p[3], '\0' };
+  return std::strtoul(hex, nullptr, 16);
+}
+
+void json_unescape(const char* begin, size_t length, std::string& out) {
+  out.clear();
+  const char* end = begin + length;
+  for(const char* p = begin; p < end; ++p) {
+    if(*p != '\\' || p + 1 >= end) {
+      out += *p;
+      continue;
+    }
+    switch(*++p) {
+    case 'b': out += '\b'; break;
+    case 'f': out += '\f'; break;
+    case 'n': out += '\n'; break;
+    case 'r': out += '\r'; break;
+    case 't': out += '\t'; break;
+    case 'u':
+      if(p + 4 < end) {
+        unsigned long code = read_hex4(p + 1);
+        p += 4;
+        // surrogate pair
+        if(code >= 0xD800 && code < 0xDC00 && p + 6 < end && p[1] == '\\' && p[2] == 'u') {
+          unsigned long low = read_hex4(p + 3);
+          if(low >= 0xDC00 && low < 0xE000) {
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            p += 6;
+          }
+        }
+        append_utf8(code, out);
+      }
+      break;
+    default: out += *p; // \" \\ \/
+    }
+  }
+}
+
+// Column of one field: numeric, logical or, when the kinds are mixed, character
+static SEXP json_column(const JsonValue* values, size_t n, size_t stride) {
+  bool numbers = false, logicals = false, text = false;
+  for(size_t i = 0; i < n; ++i) {
+    switch(values[i * stride].kind) {
+    case JsonKind::Number: numbers = true; break;
+    case JsonKind::True:
+    case JsonKind::False: logicals = true; break;
+    case JsonKind::String:
+    case JsonKind::Other: text = true; break;
+    default: break;
+    }
+  }
+
+  if(!text && !(numbers && logicals)) {
+    if(numbers) {
+      NumericVector column(n);
+      for(size_t i = 0; i < n; ++i) {
+        const JsonValue& value = values[i * stride];
+        column[i] = value.kind == JsonKind::Number ? value.number : NA_REAL;
+      }
+      return column;
+    }
+    LogicalVector column(n);
+    for(size_t i = 0; i < n; ++i) {
+      JsonKind kind = values[i * stride].kind;
+      column[i] = kind == JsonKind::True ? TRUE : kind == JsonKind::False ? FALSE : NA_LOGICAL;
+    }
+    return column;
+  }
+
+  CharacterVector column(n);
+  std::string buffer;
+  for(size_t i = 0; i < n; ++i) {
+    const JsonValue& value = values[i * stride];
+    if(value.kind == JsonKind::Missing || value.kind == JsonKind::Null) {
+      SET_STRING_ELT(column, i, NA_STRING);
+    } else if(value.kind == JsonKind::String && std::memchr(value.begin, '\\', value.length)) {
+      json_unescape(value.begin, value.length, buffer);
+      SET_STRING_ELT(column, i, Rf_mkCharLenCE(buffer.data(), (int)buffer.size(), CE_UTF8));
+    } else {
+      // plain strings, and the raw text of numbers, literals, objects and arrays
+      SET_STRING_ELT(column, i, Rf_mkCharLenCE(value.begin, (int)value.length, CE_UTF8));
+    }
+  }
+  return column;
+}
+
+DataFrame json_table(const std::vector<std::string_view>& payloads, CharacterVector fields) {
+  std::vector<std::vector<std::string>> paths;
+  for(R_xlen_t f = 0; f < fields.size(); ++f) {
+    paths.push_back(json_path(Rcpp::as<std::string>(fields[f])));
+  }
+
+  std::vector<JsonValue> values(payloads.size() * paths.size());
+  json_extract(payloads, paths, values.data());
+
+  List columns(paths.size());
+  for(size_t f = 0; f < paths.size(); ++f) {
+    columns[f] = json_column(values.data() + f, payloads.size(), paths.size());
+  }
+  columns.names() = fields;
+
+  return DataFrame(columns);
+}
+
+// [[Rcpp::export]]
+DataFrame json_fields(CharacterVector x, CharacterVector fields) {
+  std::vector<std::string_view> payloads(x.size());
+  for(R_xlen_t i = 0; i < x.size(); ++i) {
+    SEXP payload = STRING_ELT(x, i);
+    if(payload != NA_STRING) {
+      payloads[i] = std::string_view(CHAR(payload), LENGTH(payload));
+    }
+  }
+  return json_table(payloads, fields);
+}
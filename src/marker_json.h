@@ -0,0 +1,62 @@
+/*
+ *  \file marker_json.h
+ * Extraction of fields from JSON marker payloads
+ */
+
+#ifndef MARKER_JSON_H
+#define MARKER_JSON_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*!
+ * \brief Kind of a JSON value found by json_extract().
+ */
+enum class JsonKind : unsigned char
+{
+    Missing,    /*!< The path is not in the payload, or the payload is not valid JSON. */
+    Null,
+    Number,
+    True,
+    False,
+    String,     /*!< `begin`/`length` are the raw contents between the quotes, still escaped. */
+    Other       /*!< Object or array; `begin`/`length` are its raw text. */
+};
+
+/*!
+ * \brief One extracted value, pointing into the payload it came from.
+ */
+struct JsonValue
+{
+    const char* begin = nullptr;
+    size_t length = 0;
+    JsonKind kind = JsonKind::Missing;
+    double number = 0;          /*!< Value of a Number. */
+};
+
+/*!
+ * \brief Split a field path such as `"trial.stimulus.0"` into its keys.
+ *
+ * Keys are separated by dots; a key made of digits also indexes arrays.
+ */
+std::vector<std::string> json_path(const std::string& field);
+
+/*!
+ * \brief Find every path in every payload.
+ *
+ * `out` is laid out payloads x paths in C order. The payloads are scanned in
+ * place without allocating, in parallel; the values point into them, so they
+ * must outlive `out`. Payloads of a string stream can be passed as views of
+ * its `StringArena`.
+ */
+void json_extract(const std::vector<std::string_view>& payloads, const std::vector<std::vector<std::string>>& paths,
+                  JsonValue* out);
+
+/*!
+ * \brief Decode the escapes of the contents of a JSON string into `out`, as UTF-8.
+ */
+void json_unescape(const char* begin, size_t length, std::string& out);
+
+#endif // MARKER_JSON_H
@@ -578,3 +578,91 @@ struct PMultiStageDef* build_fast_ratios(int fsin, int fsout, double tol, double
 
 	return pdef;
 }
+
+#define MAX_PRIME_FACTORS 32
+#define MIN_COARSE_RATE_FACTOR 2
+
+static int compare_int_desc(const void* e1, const void* e2) {
+	return *(const int*) e2 - *(const int*) e1;
+}
+
+/**
+ * Multistage plan for large decimation ratios (e.g. 44100Hz audio to 250Hz).
+ * Prime factors of M are used as early coarse decimation stages, largest first, as
+ * long as the stage output rate stays above MIN_COARSE_RATE_FACTOR*fsout: these stages
+ * have a wide transition band and need short filters. When a factor would bring the rate
+ * lower, the smallest interpolation factors needed to stay above are merged into that
+ * stage. All remaining factors make the final sharp stage, whose input rate is close to
+ * fsout so that its filter length stays bounded whatever the overall ratio.
+ * Stages are not reordered afterwards.
+ */
+struct PMultiStageDef* build_decimation_ratios(int fsin, int fsout, double tol) {
+	int L = 0;
+	int M = 0;
+	double rat = (double) fsin / fsout;
+	find_ratio(rat, tol * rat, &M, &L);
+	{
+		// the exact ratio may have smaller prime factors than its approximation
+		int pgcd = find_pgcd(fsin,fsout);
+		int exactL = fsout / pgcd;
+		int exactM = fsin / pgcd;
+		int maxp = get_max_prime_factor(L) > get_max_prime_factor(M) ? get_max_prime_factor(L) : get_max_prime_factor(M);
+		if (get_max_prime_factor(exactL) <= maxp && get_max_prime_factor(exactM) <= maxp) {
+			L = exactL;
+			M = exactM;
+		}
+	}
+
+	int LL[MAX_PRIME_FACTORS];
+	int nbL = MAX_PRIME_FACTORS;
+	int MM[MAX_PRIME_FACTORS];
+	int nbM = MAX_PRIME_FACTORS;
+	if (factors(L, LL, &nbL) != 1 || factors(M, MM, &nbM) != 1) {
+		printf("ERROR: too many factors for %i/%i !\n", L, M);
+		return NULL;
+	}
+	qsort(MM, nbM, sizeof(int), compare_int_desc);
+	// LL is already sorted in ascending order
+
+	struct PMultiStageDef* pdef = malloc(sizeof(struct PMultiStageDef));
+	pdef->nb_stages = 0;
+	pdef->L = malloc(2 * (nbM + 1) * sizeof(int));
+	pdef->M = &pdef->L[nbM + 1];
+
+	double rate = fsin;
+	const double minRate = (double) MIN_COARSE_RATE_FACTOR * fsout;
+	int usedL = 0;
+	int usedM = 0;
+	while (usedM < nbM) {
+		int p = MM[usedM];
+		int q = 1;
+		int nextL = usedL;
+		while (rate * q / p < minRate && nextL < nbL)
+			q *= LL[nextL++];
+		if (rate * q / p < minRate)
+			break;
+		pdef->L[pdef->nb_stages] = q;
+		pdef->M[pdef->nb_stages] = p;
+		pdef->nb_stages++;
+		rate = rate * q / p;
+		usedL = nextL;
+		usedM++;
+	}
+
+	// final stage with remaining factors
+	{
+		int q = 1;
+		int p = 1;
+		for (int i = usedL; i < nbL; i++)
+			q *= LL[i];
+		for (int i = usedM; i < nbM; i++)
+			p *= MM[i];
+		if (q != 1 || p != 1) {
+			pdef->L[pdef->nb_stages] = q;
+			pdef->M[pdef->nb_stages] = p;
+			pdef->nb_stages++;
+		}
+	}
+
+	return pdef;
+}
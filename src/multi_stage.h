@@ -41,6 +41,7 @@ struct PMultiStageDef* get_predef_ratios(int fsin, int fsout);
 struct PMultiStageDef* get_user_ratios(int fsin, int fsout, const char* userdef);
 struct PMultiStageDef* build_auto_ratios(int fsin, int fsout, double tol);
 struct PMultiStageDef* build_fast_ratios(int fsin, int fsout, double tol, double bandwidth,double rp,double rs);
+struct PMultiStageDef* build_decimation_ratios(int fsin, int fsout, double tol);
 void destroy_multistagedef(struct PMultiStageDef*);
 
 #endif /* MULTI_STAGE_H_ */
@@ -5,22 +5,59 @@
 
 #include <Rcpp.h>
 #include <string>
-#include <regex>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
 #include "xdf.h"
+#include "smarc.h"
 #include "rxdf.h"
+#include "lazy_columns.h"
 
 using namespace Rcpp;
 
 // [[Rcpp::export]]
-List load_xdf(Rcpp::String filename_, Rcpp::Nullable<Rcpp::NumericVector> stream_ids = R_NilValue) {
+List load_xdf(Rcpp::String filename_, Rcpp::Nullable<Rcpp::NumericVector> stream_ids = R_NilValue,
+              Rcpp::Nullable<Rcpp::NumericVector> target_rate = R_NilValue, std::string quality = "standard",
+              Rcpp::Nullable<Rcpp::List> resample_options = R_NilValue, bool dejitter = true, bool lazy = false) {
   
   std::string filename = filename_.get_cstring();
   // capture the Xdf data object
   Xdf xdf_data;
   
-  xdf_data.load_xdf(filename);
+  if(lazy && target_rate.isNotNull()) {
+    Rcpp::stop("target_rate cannot be used with lazy = TRUE");
+  }
+  
+  Xdf::LoadOptions load_options = get_load_options(target_rate, quality, resample_options, dejitter);
+  // numeric values stay in the file, and channels are read through a memory map when used
+  load_options.lazyValues = lazy;
+  std::shared_ptr<MappedFile> mapped_file;
+  if(lazy) {
+    mapped_file = map_file(filename);
+  }
+  xdf_data.load_xdf(filename, load_options);
+  // regular streams keep compact time stamps only, expanded stream by stream below
+  xdf_data.freeUpTimeStamps();
   // xdf_data.createLabels();  // this information has better formatting by working through the channels procedure
   
+  return get_xdf(xdf_data, stream_ids, mapped_file);
+}
+
+Xdf::LoadOptions get_load_options(Rcpp::Nullable<Rcpp::NumericVector> target_rate, const std::string& quality,
+                                  Rcpp::Nullable<Rcpp::List> resample_options, bool dejitter) {
+  Xdf::LoadOptions load_options;
+  load_options.dejitter = dejitter;
+  // with a target rate, numeric streams are resampled chunk by chunk as they are read
+  if(target_rate.isNotNull()) {
+    load_options.userSrate = Rcpp::as<int>(target_rate);
+    load_options.resample = get_resample_options(quality, resample_options);
+  }
+  return load_options;
+}
+
+List get_xdf(Xdf& xdf_data, Rcpp::Nullable<Rcpp::NumericVector> stream_ids,
+             const std::shared_ptr<MappedFile>& mapped_file) {
   Rcpp::NumericVector indices;
   if(stream_ids.isNotNull()) {
     indices = Rcpp::as<Rcpp::NumericVector>(stream_ids);
@@ -37,77 +74,16 @@ List load_xdf(Rcpp::String filename_, Rcpp::Nullable<Rcpp::NumericVector> stream
   
   for (size_t j = 0; j < indices.size(); ++j) {
     i = indices[j] - 1;
-    //*****************************************************************************
-    // 
-    // Apply methods special methods where needed
-    // 
-    //*****************************************************************************
-    
-    // Channels
-    DataFrame channels = get_channels(xdf_data.streams[i].info.channels);
-    
-    DataFrame time_series = get_timeseries(xdf_data.streams[i].time_series);
-    CharacterVector clean_names(xdf_data.streams[i].info.channel_count);
-    
-    if(time_series.ncol() > 0) {
-      if(channels.containsElementNamed("label") && (time_series.ncol() == channels.nrow())) {
-        if(channels.containsElementNamed("unit")){
-          clean_names = make_clean_names(channels["label"], channels["unit"]);
-        } else {
-          clean_names = make_clean_names(channels["label"]);
-        }
-        
-      } else {
-        for(int i = 0; i < time_series.ncol(); ++i) {
-          clean_names[i] = "V" + std::to_string(i + 1);
-        }
-      } 
-      time_series.names() = clean_names;
-      time_series["time_stamp"] = xdf_data.streams[i].time_stamps;
-    }
-    
-    
-    // Clock Offset
-    NumericVector clock_offsets(xdf_data.streams[i].info.clock_offsets.size());
-    CharacterVector clock_offset_names(xdf_data.streams[i].info.clock_offsets.size());
-    for(size_t i = 0; i < xdf_data.streams[i].info.clock_offsets.size(); ++i) {
-      clock_offsets[i] = xdf_data.streams[i].info.clock_offsets[i].second;
-      clock_offset_names[i] = xdf_data.streams[i].info.clock_offsets[i].first;
-    }
-    clock_offsets.names() = clock_offset_names;
-    
-    List info = List::create(
-      Named("channel_count") = xdf_data.streams[i].info.channel_count,
-      Named("nominal_srate") = xdf_data.streams[i].info.nominal_srate,
-      Named("type") = xdf_data.streams[i].info.type,
-      Named("channel_format") = xdf_data.streams[i].info.channel_format,
-      Named("channels") = get_channels(xdf_data.streams[i].info.channels),
-      Named("clock_offsets") = clock_offsets,
-      Named("first_timestamp") = xdf_data.streams[i].info.first_timestamp,  // This part of the xdf.cpp code is not working (crashes R)
-      Named("last_timestamp") = xdf_data.streams[i].info.last_timestamp, // This part of the xdf.cpp code is not working (crashes R)
-      Named("sample_count") = xdf_data.streams[i].info.sample_count,
-      Named("measured_srate") = xdf_data.streams[i].info.measured_srate,
-      Named("effective_sample_rate") = xdf_data.streams[i].info.effective_sample_rate
-    );
-    
-    streams[i] = List::create(
-      // Named("stream") = stream_cols,
-      Named("time_series") = time_series,
-      Named("time_stamps") = wrap(xdf_data.streams[i].time_stamps),
-      Named("info") = info,
-      Named("stream_header") = xdf_data.streams[i].streamHeader,
-      Named("stream_footer") = xdf_data.streams[i].streamFooter,
-      Named("last_timestamp") = xdf_data.streams[i].last_timestamp,
-      Named("sampling_interval") = xdf_data.streams[i].sampling_interval,
-      Named("clock_times") = wrap(xdf_data.streams[i].clock_times),
-      Named("clock_values") = wrap(xdf_data.streams[i].clock_values)
-    );
-    
-    stream_names[i] = xdf_data.streams[i].info.name + "_" + std::to_string(i + 1);
+    Xdf::Stream& stream = xdf_data.streams[i];
+    DataFrame time_series = stream.sample_chunks.empty() ? get_timeseries(stream) :
+      get_lazy_timeseries(mapped_file, stream);
+    streams[i] = get_stream(stream, time_series, get_time_stamps(stream));
+    stream_names[i] = stream.info.name + "_" + std::to_string(i + 1);
   }
   streams.names() = stream_names;
   
-  DataFrame event_map = get_event_mapping(xdf_data.eventMap);
+  IntegerVector event_type = get_event_types(xdf_data.eventType, xdf_data.dictionary);
+  DataFrame event_map = get_event_mapping(xdf_data.eventMap, event_type);
   
   return List::create(
     Named("version") = xdf_data.version,
@@ -122,9 +98,9 @@ List load_xdf(Rcpp::String filename_, Rcpp::Nullable<Rcpp::NumericVector> stream
     Named("common_sample_rate") = wrap(xdf_data.fileEffectiveSampleRate),
     Named("stream_map") = wrap(xdf_data.streamMap),
     Named("file_header") = wrap(xdf_data.fileHeader),
-    // Named("dictionary") = wrap(xdf_data.dictionary),
+    Named("dictionary") = wrap(xdf_data.dictionary),
     // Named("labels") = wrap(xdf_data.labels),
-    Named("event_type") = wrap(xdf_data.eventType),
+    Named("event_type") = event_type,
     Named("event_map") = event_map,
     Named("offsets") = wrap(xdf_data.offsets)
     // Named("user_created_events") = wrap(xdf_data.userCreatedEvents)
@@ -136,100 +112,284 @@ List load_xdf(Rcpp::String filename_, Rcpp::Nullable<Rcpp::NumericVector> stream
   
 }
 
-DataFrame get_channels(const std::vector<std::map<std::string, std::string>> data) {
+// [[Rcpp::export]]
+IntegerVector time_to_index(NumericVector time_stamps, NumericVector times, std::string method = "nearest") {
+  std::vector<int64_t> found(times.size());
+  Xdf::timeToIndex(time_stamps.begin(), time_stamps.size(), times.begin(), times.size(), get_index_method(method),
+                   found.data());
+  return get_indices(found);
+}
+
+Xdf::IndexMethod get_index_method(const std::string& method) {
+  if(method == "nearest") {
+    return Xdf::IndexMethod::Nearest;
+  } else if(method == "floor") {
+    return Xdf::IndexMethod::Floor;
+  } else if(method == "ceil") {
+    return Xdf::IndexMethod::Ceil;
+  }
+  Rcpp::stop("Unknown method '%s' (expected 'nearest', 'floor' or 'ceil')", method);
+}
+
+IntegerVector get_indices(const std::vector<int64_t>& found) {
+  // 1-based indices for R, NA where there is no such sample
+  IntegerVector indices(found.size());
+  for(size_t i = 0; i < found.size(); ++i) {
+    indices[i] = found[i] < 0 ? NA_INTEGER : (int)(found[i] + 1);
+  }
+  return indices;
+}
+
+Xdf::ResampleOptions get_resample_options(const std::string& quality, Rcpp::Nullable<Rcpp::List> overrides) {
+  Xdf::ResampleOptions options;
+  
+  if(quality == "draft") {
+    options = Xdf::ResampleOptions::preset(Xdf::ResampleQuality::Draft);
+  } else if(quality == "standard") {
+    options = Xdf::ResampleOptions::preset(Xdf::ResampleQuality::Standard);
+  } else if(quality == "archival") {
+    options = Xdf::ResampleOptions::preset(Xdf::ResampleQuality::Archival);
+  } else {
+    Rcpp::stop("Unknown resampling quality '%s' (expected 'draft', 'standard' or 'archival')", quality);
+  }
+  
+  // explicit overrides take precedence over the preset
+  if(overrides.isNotNull()) {
+    List user = Rcpp::as<List>(overrides);
+    if(user.containsElementNamed("bandwidth")) options.bandwidth = Rcpp::as<double>(user["bandwidth"]);
+    if(user.containsElementNamed("rp")) options.rp = Rcpp::as<double>(user["rp"]);
+    if(user.containsElementNamed("rs")) options.rs = Rcpp::as<double>(user["rs"]);
+    if(user.containsElementNamed("tol")) options.tol = Rcpp::as<double>(user["tol"]);
+    if(user.containsElementNamed("design")) {
+      std::string design = Rcpp::as<std::string>(user["design"]);
+      if(design == "remez") {
+        options.design = SMARC_DESIGN_REMEZ;
+      } else if(design == "kaiser") {
+        options.design = SMARC_DESIGN_KAISER;
+      } else {
+        Rcpp::stop("Unknown filter design '%s' (expected 'remez' or 'kaiser')", design);
+      }
+    }
+  }
+  return options;
+}
+
+DataFrame get_channels(const Xdf::ChannelTable& data) {
   if(data.empty()) {
     return DataFrame::create();
   }
-  // Channels
-  std::vector<std::string> channel_names;
-  for (const auto& map : data) {
-    for(const auto& pair : map) {
-      if(std::find(channel_names.begin(), channel_names.end(), pair.first) == channel_names.end()) {
-        channel_names.push_back(pair.first);
-      }
+  
+  // columns in alphabetical order, as they came out of the std::map the table used to be
+  std::vector<size_t> order(data.keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&data](size_t a, size_t b) { return data.keys[a] < data.keys[b]; });
+
+  List channels(order.size());
+  CharacterVector names(order.size());
+  for(size_t c = 0; c < order.size(); ++c) {
+    const size_t k = order[c];
+    CharacterVector column(data.size());
+    for(size_t i = 0; i < data.size(); ++i) {
+      const std::string& value = data.values[k][i];
+      SET_STRING_ELT(column, i, data.present[k][i] ?
+                     Rf_mkCharLenCE(value.data(), (int)value.size(), CE_UTF8) : NA_STRING);
     }
+    channels[c] = column;
+    names[c] = data.keys[k];
   }
-  std::vector<Rcpp::CharacterVector> channel_contents(channel_names.size());
-  for (const auto& map : data) {
-    for(size_t i = 0; i < channel_names.size(); ++i) {
-      auto it = map.find(channel_names[i]);
-      if(it != map.end()) {
-        channel_contents[i].push_back(it->second);
-      } else {
-        channel_contents[i].push_back(NA_STRING);
-      } 
+  channels.names() = names;
+  
+  return DataFrame(channels);
+}
+
+// Append the clean form of a label to out: runs of bytes other than [a-zA-Z0-9_]
+// become one "_" and letters are lowercased. A unit, minus any "NotDefined",
+// is appended after a "_".
+static void append_clean_name(const char* label, const char* unit, std::string& out) {
+  bool in_run = false;
+  for(const char* p = label; *p; ++p) {
+    char c = *p;
+    if((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_') {
+      out += c;
+      in_run = false;
+    } else if(c >= 'A' && c <= 'Z') {
+      out += (char)(c - 'A' + 'a');
+      in_run = false;
+    } else if(!in_run) {
+      out += '_';
+      in_run = true;
     }
   }
-  DataFrame channels = wrap(channel_contents);
-  channels.names() = Rcpp::CharacterVector(channel_names.begin(), channel_names.end());
   
-  return channels;
+  if(unit) {
+    static const char undef_word[] = "NotDefined";
+    const size_t undef_size = sizeof(undef_word) - 1;
+    size_t name_size = out.size();
+    out += '_';
+    for(const char* p = unit; *p; ++p) {
+      if(std::strncmp(p, undef_word, undef_size) == 0) {
+        p += undef_size - 1;
+      } else {
+        out += *p;
+      }
+    }
+    if(out.size() == name_size + 1) {
+      out.resize(name_size);
+    }
+  }
 }
 
-CharacterVector make_clean_names(CharacterVector label, CharacterVector units) {
+static CharacterVector clean_names(CharacterVector label, const CharacterVector* units) {
   int n = label.size();
-  std::string undef_word = "NotDefined";
-  
-  std::regex pattern("[^a-zA-Z0-9_]+");
-  std::string replacement = "_";
-  
   CharacterVector clean_names(n);
   
+  // repeated names get _2, _3, ... in order, skipping names already taken
+  std::unordered_map<std::string, int> seen;
+  std::string name;
   for(int i = 0; i < n; ++i) {
-    std::string label_str = as<std::string>(label[i]);
-    std::string units_str = as<std::string>(units[i]);
-    
-    label_str = std::regex_replace(label_str, pattern, replacement);
-    
-    // Convert to lowercase
-    std::transform(label_str.begin(), label_str.end(), label_str.begin(), ::tolower);
+    name.clear();
+    append_clean_name(CHAR(STRING_ELT(label, i)), units ? CHAR(STRING_ELT(*units, i)) : nullptr, name);
     
-    // Remove "not defined" units
-    size_t pos = units_str.find(undef_word);
-    while(pos != std::string::npos) {
-      units_str.replace(pos, undef_word.size(), "");
-      
-      pos = units_str.find(undef_word, pos);
-    }
-    
-    if(units_str.empty()) {
-      clean_names[i] = label_str;
-    } else {
-      clean_names[i] = label_str + "_" + units_str;
+    auto first = seen.emplace(name, 1);
+    if(!first.second) {
+      std::string base = name;
+      int& count = first.first->second;
+      do {
+        name = base + "_" + std::to_string(++count);
+      } while(!seen.emplace(name, 1).second);
     }
+    SET_STRING_ELT(clean_names, i, Rf_mkCharLenCE(name.data(), (int)name.size(), CE_UTF8));
   }
   return clean_names;
 }
+
+CharacterVector make_clean_names(CharacterVector label, CharacterVector units) {
+  return clean_names(label, &units);
+}
+
 CharacterVector make_clean_names(CharacterVector label) {
-  int n = label.size();
-  std::string undef_word = "NotDefined";
+  return clean_names(label, nullptr);
+}
+
+// time_stamps is left a SEXP: wrapping it in a NumericVector would expand compact time stamps
+List get_stream(Xdf::Stream& stream, DataFrame time_series, SEXP time_stamps) {
+  // Channels, parsed from the stream header only for the streams returned
+  DataFrame channels = get_channels(Xdf::channelInfo(stream));
   
-  std::regex pattern("[^a-zA-Z0-9_]+");
-  std::string replacement = "_";
+  const int ncol = time_series.ncol();
+  if(ncol > 0) {
+    // rebuilt rather than grown, which would take the columns through as.data.frame()
+    CharacterVector column_names = get_column_names(channels, ncol);
+    List columns(ncol + 1);
+    CharacterVector names(ncol + 1);
+    for(int k = 0; k < ncol; ++k) {
+      columns[k] = time_series[k];
+      names[k] = column_names[k];
+    }
+    columns[ncol] = time_stamps;
+    names[ncol] = "time_stamp";
+    time_series = new_data_frame(columns, names, Rf_xlength(time_stamps));
+  }
   
-  CharacterVector clean_names(n);
+  // Clock Offset
+  NumericVector clock_offsets(stream.info.clock_offsets.size());
+  CharacterVector clock_offset_names(stream.info.clock_offsets.size());
+  for(size_t k = 0; k < stream.info.clock_offsets.size(); ++k) {
+    clock_offsets[k] = stream.info.clock_offsets[k].second;
+    clock_offset_names[k] = stream.info.clock_offsets[k].first;
+  }
+  clock_offsets.names() = clock_offset_names;
   
-  for(int i = 0; i < n; ++i) {
-    std::string label_str = as<std::string>(label[i]);
-    
-    label_str = std::regex_replace(label_str, pattern, replacement);
-    
-    // Convert to lowercase
-    std::transform(label_str.begin(), label_str.end(), label_str.begin(), ::tolower);
+  List info = List::create(
+    Named("channel_count") = stream.info.channel_count,
+    Named("nominal_srate") = stream.info.nominal_srate,
+    Named("type") = stream.info.type,
+    Named("channel_format") = stream.info.channel_format,
+    Named("channels") = channels,
+    Named("clock_offsets") = clock_offsets,
+    Named("first_timestamp") = stream.info.first_timestamp,  // This part of the xdf.cpp code is not working (crashes R)
+    Named("last_timestamp") = stream.info.last_timestamp, // This part of the xdf.cpp code is not working (crashes R)
+    Named("sample_count") = stream.info.sample_count,
+    Named("measured_srate") = stream.info.measured_srate,
+    Named("effective_sample_rate") = stream.info.effective_sample_rate
+  );
   
-  clean_names[i] = label_str;
+  return List::create(
+    // Named("stream") = stream_cols,
+    Named("time_series") = time_series,
+    Named("time_stamps") = time_stamps,
+    Named("info") = info,
+    Named("stream_header") = stream.streamHeader,
+    Named("stream_footer") = Xdf::footerXml(stream),
+    Named("last_timestamp") = stream.last_timestamp,
+    Named("sampling_interval") = stream.sampling_interval,
+    Named("clock_times") = wrap(stream.clock_times),
+    Named("clock_values") = wrap(stream.clock_values)
+  );
+}
+
+CharacterVector get_column_names(const DataFrame& channels, int ncol) {
+  CharacterVector clean_names(ncol);
+  if(channels.containsElementNamed("label") && (ncol == channels.nrow())) {
+    if(channels.containsElementNamed("unit")){
+      clean_names = make_clean_names(channels["label"], channels["unit"]);
+    } else {
+      clean_names = make_clean_names(channels["label"]);
+    }
+  } else {
+    for(int i = 0; i < ncol; ++i) {
+      clean_names[i] = "V" + std::to_string(i + 1);
+    }
   }
   return clean_names;
 }
 
-DataFrame get_event_mapping(const std::vector<std::pair<std::pair<std::string, double>, int>> &data) {
+// Set the attributes of a data.frame directly: Rcpp's DataFrame(List) calls
+// as.data.frame(), which reads the columns to name and check them
+DataFrame new_data_frame(List columns, CharacterVector names, R_xlen_t nrow) {
+  columns.names() = names;
+  columns.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int)nrow);
+  columns.attr("class") = "data.frame";
+  return DataFrame((SEXP)columns);
+}
+
+RObject get_time_stamps(const Xdf::Stream& stream, size_t first, size_t count) {
+  size_t size = stream.time_stamps.empty() ? stream.compact_time_stamps.size() : stream.time_stamps.size();
+  first = std::min(first, size);
+  count = std::min(count, size - first);
+  
+  if(!stream.time_stamps.empty() || stream.compact_time_stamps.empty()) {
+    return wrap(NumericVector(stream.time_stamps.begin() + first, stream.time_stamps.begin() + first + count));
+  }
+  
+  // a whole regular stream stays compact on the R side too, until the vector itself is needed
+  if(count == size) {
+    return get_lazy_time_stamps(stream.compact_time_stamps);
+  }
+  NumericVector time_stamps(count);
+  for(size_t k = 0; k < count; ++k) {
+    time_stamps[k] = stream.compact_time_stamps.at(first + k);
+  }
+  return wrap(time_stamps);
+}
+
+IntegerVector get_event_types(const std::vector<uint32_t>& codes, const std::vector<std::string>& levels) {
+  
+  IntegerVector event_type(codes.size());
+  for (size_t i = 0; i < codes.size(); ++i) {
+    event_type[i] = (int)codes[i] + 1;
+  }
+  event_type.attr("levels") = wrap(levels);
+  event_type.attr("class") = "factor";
+  return event_type;
+}
+
+DataFrame get_event_mapping(const std::vector<std::pair<std::pair<std::string, double>, int>> &data, IntegerVector event_name) {
   
-  std::vector<std::string> event_name;
   std::vector<double> event_timestamp;
   std::vector<int> value;
   
   for (const auto& item : data) {
-    event_name.push_back(item.first.first);
     event_timestamp.push_back(item.first.second);
     value.push_back(item.second);
   }
@@ -240,13 +400,19 @@ DataFrame get_event_mapping(const std::vector<std::pair<std::pair<std::string, d
   );
 }
 
-DataFrame get_timeseries(const std::vector<std::vector<std::variant<int, float, double, int64_t, std::string>>>& data) {
+DataFrame get_timeseries(const Xdf::Stream& stream, size_t first, size_t count) {
+  if(!stream.string_series.empty()) {
+    return get_string_series(stream.string_series, stream.info.channel_count, first, count);
+  }
+  
+  const auto& data = stream.time_series;
   if(data.empty() || data[0].empty()) {
     return Rcpp::DataFrame();
   }
   
   size_t num_cols = data.size();
-  size_t num_rows = data[0].size();
+  first = std::min(first, data[0].size());
+  size_t num_rows = std::min(count, data[0].size() - first);
   
   Rcpp::List columns(num_cols);
   
@@ -257,31 +423,31 @@ DataFrame get_timeseries(const std::vector<std::vector<std::variant<int, float,
     if(std::holds_alternative<int>(first_value)) {
       IntegerVector column(num_rows);
       for(size_t i = 0; i < num_rows; ++i){
-        column[i] = std::get<int>(data[j][i]);  // Get value from correct row
+        column[i] = std::get<int>(data[j][first + i]);  // Get value from correct row
       }
       columns[j] = column;
     } else if(std::holds_alternative<int64_t>(first_value)) {
       IntegerVector column(num_rows);
       for(size_t i = 0; i < num_rows; ++i){
-        column[i] = std::get<int64_t>(data[j][i]);  // Get value from correct row
+        column[i] = std::get<int64_t>(data[j][first + i]);  // Get value from correct row
       }
       columns[j] = column;
     } else if(std::holds_alternative<float>(first_value)) {
       NumericVector column(num_rows);
       for(size_t i = 0; i < num_rows; ++i){
-        column[i] = std::get<float>(data[j][i]);  // Get value from correct row
+        column[i] = std::get<float>(data[j][first + i]);  // Get value from correct row
       }
       columns[j] = column;
     } else if(std::holds_alternative<double>(first_value)) {
       NumericVector column(num_rows);
       for(size_t i = 0; i < num_rows; ++i){
-        column[i] = std::get<double>(data[j][i]);  // Get value from correct row
+        column[i] = std::get<double>(data[j][first + i]);  // Get value from correct row
       }
       columns[j] = column;
     } else if(std::holds_alternative<std::string>(first_value)) {
       CharacterVector column(num_rows);
       for(size_t i = 0; i < num_rows; ++i){
-        column[i] = std::get<std::string>(data[j][i]);  // Get value from correct row
+        column[i] = std::get<std::string>(data[j][first + i]);  // Get value from correct row
       }
       columns[j] = column;
     }
@@ -289,3 +455,27 @@ DataFrame get_timeseries(const std::vector<std::vector<std::variant<int, float,
   
   return Rcpp::DataFrame(columns);
 }
+
+DataFrame get_string_series(const Xdf::StringArena& values, int channel_count, size_t first, size_t count) {
+  if(channel_count <= 0) {
+    return Rcpp::DataFrame();
+  }
+  
+  size_t num_cols = channel_count;
+  first = std::min(first, values.size() / num_cols);
+  size_t num_rows = std::min(count, values.size() / num_cols - first);
+  
+  Rcpp::List columns(num_cols);
+  
+  for(size_t j = 0; j < num_cols; ++j) {
+    CharacterVector column(num_rows);
+    for(size_t i = 0; i < num_rows; ++i) {
+      // straight from the arena, without an intermediate std::string
+      size_t k = (first + i) * num_cols + j;
+      SET_STRING_ELT(column, i, Rf_mkCharLenCE(values.data(k), (int)values.length(k), CE_UTF8));
+    }
+    columns[j] = column;
+  }
+  
+  return Rcpp::DataFrame(columns);
+}
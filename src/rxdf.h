@@ -1,8 +1,40 @@
 #include <Rcpp.h>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "xdf.h"
+#include "epoch.h"
 
-Rcpp::List get_xdf(Rcpp::String filename_);
-Rcpp::DataFrame get_channels(const std::vector<std::map<std::string, std::string>> data);
+class MappedFile;
+
+Xdf::LoadOptions get_load_options(Rcpp::Nullable<Rcpp::NumericVector> target_rate, const std::string& quality,
+                                  Rcpp::Nullable<Rcpp::List> resample_options, bool dejitter);
+Rcpp::List get_xdf(Xdf& xdf_data, Rcpp::Nullable<Rcpp::NumericVector> stream_ids,
+                   const std::shared_ptr<MappedFile>& mapped_file);
+Xdf::ResampleOptions get_resample_options(const std::string& quality, Rcpp::Nullable<Rcpp::List> overrides);
+Rcpp::DataFrame get_channels(const Xdf::ChannelTable& data);
 Rcpp::CharacterVector make_clean_names(Rcpp::CharacterVector names, Rcpp::CharacterVector units);
 Rcpp::CharacterVector make_clean_names(Rcpp::CharacterVector label);
-Rcpp::DataFrame get_event_mapping(const std::vector<std::pair<std::pair<std::string, double>, int>> &vec);
-Rcpp::DataFrame get_timeseries(const std::vector<std::vector<std::variant<int, float, double, int64_t, std::string>>>& data);
\ No newline at end of file
+Rcpp::RObject get_time_stamps(const Xdf::Stream& stream, size_t first = 0, size_t count = SIZE_MAX);
+Rcpp::IntegerVector get_event_types(const std::vector<uint32_t>& codes, const std::vector<std::string>& levels);
+Rcpp::DataFrame get_event_mapping(const std::vector<std::pair<std::pair<std::string, double>, int>> &vec, Rcpp::IntegerVector event_name);
+Rcpp::DataFrame get_timeseries(const Xdf::Stream& stream, size_t first = 0, size_t count = SIZE_MAX);
+Rcpp::DataFrame get_string_series(const Xdf::StringArena& values, int channel_count, size_t first = 0,
+                                  size_t count = SIZE_MAX);
+Rcpp::List get_stream(Xdf::Stream& stream, Rcpp::DataFrame time_series, SEXP time_stamps);
+Rcpp::CharacterVector get_column_names(const Rcpp::DataFrame& channels, int ncol);
+Rcpp::DataFrame new_data_frame(Rcpp::List columns, Rcpp::CharacterVector names, R_xlen_t nrow);
+Rcpp::DataFrame json_table(const std::vector<std::string_view>& payloads, Rcpp::CharacterVector fields);
+Xdf::IndexMethod get_index_method(const std::string& method);
+Rcpp::IntegerVector get_indices(const std::vector<int64_t>& found);
+EpochWindows sample_windows(const double* time_stamps, size_t n_samples, double srate, Rcpp::NumericVector events,
+                            double tmin, double tmax, Rcpp::Nullable<Rcpp::NumericVector> baseline);
+Rcpp::NumericVector epoch_array(const std::vector<const double*>& channels, Rcpp::CharacterVector channel_names,
+                                const EpochWindows& windows, double tmin, double srate);
+
+// An integer sample as an R integer; int64 values outside its range become NA
+inline int to_integer(double value) {
+  return value >= -INT_MAX && value <= INT_MAX ? (int)value : NA_INTEGER;
+}
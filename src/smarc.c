@@ -30,8 +30,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define FIRST_BUFFER_SIZE 512
+// decimation ratio from which the coarse-then-sharp planner (build_decimation_ratios) is used
+#define COARSE_DECIMATION_RATIO 20
 
 struct PFilter
 {
@@ -67,8 +72,59 @@ int smarc_get_output_buffer_size(struct PFilter* pfilt,int inSize)
 	return outSize;
 }
 
+int smarc_get_flush_buffer_size(struct PFilter* pfilt)
+{
+	// size of the last stage buffer, as allocated by smarc_init_pstate
+	int size = FIRST_BUFFER_SIZE;
+	for (int i=0;i<pfilt->nb_stages;i++)
+		size = size * pfilt->filter[i]->L / pfilt->filter[i]->M + 1;
+	return size;
+}
 
 struct PFilter* smarc_init_pfilter(int fsin, const int fsout, double bandwidth, double rp, double rs, double tol, const char* userratios, int searchfastconversion)
+{
+	return smarc_init_pfilter_design(fsin,fsout,bandwidth,rp,rs,tol,userratios,searchfastconversion,SMARC_DESIGN_REMEZ);
+}
+
+/**
+ * Build the filter of each stage of pdef into pfilt.
+ * Returns the output samplerate of the last stage, or -1 if a stage cannot be built.
+ */
+static double build_stages(struct PFilter* pfilt, const struct PMultiStageDef* pdef, int design)
+{
+	pfilt->nb_stages = pdef->nb_stages;
+	pfilt->filter = malloc(pfilt->nb_stages*sizeof(struct PSFilter*));
+
+	double stage_fsin = pfilt->fsin;
+	for (int i=0;i<pdef->nb_stages;i++)
+	{
+		double fstop = 0;
+		double fmax = pdef->L[i]*stage_fsin;
+		if (pdef->L[i] > pdef->M[i])
+		{
+			// interpolation
+			fstop = stage_fsin - pfilt->fstop;
+		} else {
+			// decimation
+			fstop = ((stage_fsin * pdef->L[i]) / pdef->M[i]) - (pfilt->fstop);
+		}
+		pfilt->filter[i] = init_psfilter(pdef->L[i],pdef->M[i],
+				pfilt->fpass / fmax,fstop / fmax,pfilt->rp,pfilt->rs,pdef->nb_stages,design);
+		if (pfilt->filter[i]==NULL)
+		{
+			for (int k=0;k<i;k++)
+				destroy_psfilter(pfilt->filter[k]);
+			free(pfilt->filter);
+			pfilt->filter = NULL;
+			pfilt->nb_stages = 0;
+			return -1;
+		}
+		stage_fsin = (stage_fsin * pdef->L[i]) / pdef->M[i];
+	}
+	return stage_fsin;
+}
+
+struct PFilter* smarc_init_pfilter_design(int fsin, const int fsout, double bandwidth, double rp, double rs, double tol, const char* userratios, int searchfastconversion, int design)
 {
     if (fsout==fsin)
     {
@@ -88,7 +144,10 @@ struct PFilter* smarc_init_pfilter(int fsin, const int fsout, double bandwidth,
 		pdef = get_predef_ratios(fsin,fsout);
 		if (!pdef)
 		{
-			pdef = build_auto_ratios(fsin,fsout, tol);
+			if (fsin >= COARSE_DECIMATION_RATIO * fsout)
+				pdef = build_decimation_ratios(fsin,fsout, tol);
+			else
+				pdef = build_auto_ratios(fsin,fsout, tol);
 		}
 	}
 
@@ -104,34 +163,30 @@ struct PFilter* smarc_init_pfilter(int fsin, const int fsout, double bandwidth,
 	pfilt->rp = rp;
 	pfilt->rs = rs;
 
-	pfilt->nb_stages = pdef->nb_stages;
-	pfilt->filter = malloc(pfilt->nb_stages*sizeof(struct PSFilter*));
-
 	pfilt->fstop = (fsin>fsout ? fsout/2 : fsin/2);
-	double fpass = bandwidth*pfilt->fstop;
-	pfilt->fpass = fpass;
-	double stage_fsin = fsin;
-	for (int i=0;i<pdef->nb_stages;i++)
+	pfilt->fpass = bandwidth*pfilt->fstop;
+
+	double stage_fsin = build_stages(pfilt,pdef,design);
+	if (stage_fsin<0 && fsin>fsout && !(userratios!=NULL && strlen(userratios)>0) && fsin<COARSE_DECIMATION_RATIO*fsout)
 	{
-		double fstop = 0;
-		double fmax = pdef->L[i]*stage_fsin;
-		if (pdef->L[i] > pdef->M[i])
-		{
-			// interpolation
-			fstop = stage_fsin - pfilt->fstop;
-		} else {
-			// decimation
-			fstop = ((stage_fsin * pdef->L[i]) / pdef->M[i]) - (pfilt->fstop);
-		}
-		pfilt->filter[i] = init_psfilter(pdef->L[i],pdef->M[i],
-				fpass / fmax,fstop / fmax,rp,rs,pdef->nb_stages);
-		if (pfilt->filter[i]==NULL)
-			return NULL;
-		stage_fsin = (stage_fsin * pdef->L[i]) / pdef->M[i];
+		// the generic plan is not feasible, fall back to coarse decimation stages and a final sharp stage
+		printf("WARNING: cannot build multistage filter, trying coarse decimation stages\n");
+		destroy_multistagedef(pdef);
+		pdef = build_decimation_ratios(fsin,fsout, tol);
+		if (pdef)
+			stage_fsin = build_stages(pfilt,pdef,design);
+	}
+	if (stage_fsin<0)
+	{
+		destroy_multistagedef(pdef);
+		free(pfilt);
+		return NULL;
 	}
 	if (fabs(stage_fsin - fsout) > tol*fsin)
 	{
 		printf("ERROR: multistage filter output %f != %i ! (there should be an error in multistage definition)\n", stage_fsin,fsout);
+		destroy_multistagedef(pdef);
+		smarc_destroy_pfilter(pfilt);
 		return NULL;
 	} else if (stage_fsin!=fsout)
 	{
@@ -312,7 +367,7 @@ int smarc_resample(struct PFilter* pfilt, struct PState* pstate,
 		{
 			struct PStageBuffer* lbuf = pstate->buffer[pstate->nb_stages];
 			int toWrite = lbuf->pos;
-			if (nbWritten + toWrite >= outputLength) {
+			if (nbWritten + toWrite > outputLength) {
 				printf("WARNING: cannot write all output samples, please provide larger output buffer !");
 				toWrite = outputLength - nbWritten;
 			}
@@ -387,5 +442,124 @@ int smarc_resample_flush(struct PFilter* pfilt, struct PState* pstate,
 			pstate->flush_stage++;
 		}
 	}
+	// once all stages are flushed, what did not fit in the output is still in the last buffer
+	if (pstate->flush_stage==pfilt->nb_stages && nbWritten<outputLength)
+	{
+		struct PStageBuffer* lbuf = pstate->buffer[pstate->nb_stages];
+		int toWrite = lbuf->pos;
+		if (toWrite > outputLength - nbWritten)
+			toWrite = outputLength - nbWritten;
+		if (toWrite>0) {
+			memcpy(output + nbWritten,lbuf->data,toWrite*sizeof(double));
+			memmove(lbuf->data,lbuf->data+toWrite,(lbuf->pos-toWrite)*sizeof(double));
+			nbWritten += toWrite;
+			lbuf->pos -= toWrite;
+		}
+	}
+	return nbWritten;
+}
+
+/**
+ * Position a PState so that the next output sample it produces is output sample 'first'
+ * of the whole signal, as if all previous samples had been processed.
+ * Works backwards through the stages: stage output n is computed from virtual index
+ * j = n + filter_delay, at input position j*M/L (in the zero-padded stage buffer) with
+ * phase j*M%L. Stage buffers are left empty, so they must be warmed up by feeding the
+ * input signal from the returned position (K-1 samples of history per stage).
+ * Returns the index of the first input sample to feed, or -1 if the warm up would reach
+ * into the initial zero padding.
+ */
+static long long smarc_seek_pstate(struct PFilter* pfilt, struct PState* pstate, long long first)
+{
+	smarc_reset_pstate(pstate,pfilt);
+	long long n = first;
+	for (int i=pfilt->nb_stages-1;i>=0;i--)
+	{
+		const struct PSFilter* filt = pfilt->filter[i];
+		long long j = (n + filt->filter_delay) * filt->M;
+		pstate->state[i]->skip = 0;
+		pstate->state[i]->phase = (int) (j % filt->L);
+		pstate->buffer[i]->pos = 0;
+		n = j / filt->L - (filt->K - 1);
+		if (n<0)
+			return -1;
+	}
+	return n;
+}
+
+/**
+ * Returns the index of the last input sample needed to compute output sample 'last'.
+ */
+static long long smarc_last_input(struct PFilter* pfilt, long long last)
+{
+	long long n = last;
+	for (int i=pfilt->nb_stages-1;i>=0;i--)
+	{
+		const struct PSFilter* filt = pfilt->filter[i];
+		n = ((n + filt->filter_delay) * filt->M) / filt->L;
+	}
+	return n;
+}
+
+int smarc_resample_segmented(struct PFilter* pfilt,
+		const double* signal,
+		int signalLength,
+		double* output,
+		int outputLength,
+		int nbSegments)
+{
+	// choose segment boundaries (in output samples), dropping the ones whose warm up
+	// reaches the zero padding or whose previous segment would need the flush
+	long long* bounds = malloc((nbSegments+1)*sizeof(long long));
+	int nbBounds = 0;
+	{
+		long long expected = (long long) signalLength * pfilt->fsout / pfilt->fsin;
+		struct PState* probe = smarc_init_pstate(pfilt);
+		bounds[nbBounds++] = 0;
+		for (int s=1;s<nbSegments;s++)
+		{
+			long long b = expected * s / nbSegments;
+			if (b<=bounds[nbBounds-1])
+				continue;
+			if (smarc_seek_pstate(pfilt,probe,b)<0)
+				continue;
+			if (smarc_last_input(pfilt,b-1)>=signalLength)
+				break;
+			bounds[nbBounds++] = b;
+		}
+		smarc_destroy_pstate(probe);
+	}
+
+	int lastWritten = 0;
+	#pragma omp parallel for schedule(dynamic,1)
+	for (int s=0;s<nbBounds;s++)
+	{
+		struct PState* pstate = smarc_init_pstate(pfilt);
+		long long inStart = 0;
+		if (s>0)
+			inStart = smarc_seek_pstate(pfilt,pstate,bounds[s]);
+		if (s==nbBounds-1)
+		{
+			// last segment runs to the end of the signal and flushes
+			int written = smarc_resample(pfilt,pstate,signal + inStart,signalLength - (int) inStart,
+					output + bounds[s],outputLength - (int) bounds[s]);
+			written += smarc_resample_flush(pfilt,pstate,output + bounds[s] + written,
+					outputLength - (int) bounds[s] - written);
+			lastWritten = written;
+		} else {
+			// warm up and compute exactly the outputs [bounds[s], bounds[s+1])
+			int inLength = (int) (smarc_last_input(pfilt,bounds[s+1]-1) + 1 - inStart);
+			int toWrite = (int) (bounds[s+1] - bounds[s]);
+			int scratchSize = toWrite + smarc_get_output_buffer_size(pfilt,inLength);
+			double* scratch = malloc(scratchSize*sizeof(double));
+			smarc_resample(pfilt,pstate,signal + inStart,inLength,scratch,scratchSize);
+			memcpy(output + bounds[s],scratch,toWrite*sizeof(double));
+			free(scratch);
+		}
+		smarc_destroy_pstate(pstate);
+	}
+
+	int nbWritten = (int) bounds[nbBounds-1] + lastWritten;
+	free(bounds);
 	return nbWritten;
 }
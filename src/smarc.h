@@ -55,6 +55,25 @@ struct PFilter* smarc_init_pfilter(int fsin, const int fsout,
 		double bandwidth, double rp, double rs,
 		double tol, const char* userratios, int searchfastconversion);
 
+/**
+ * Filter design methods available for the stages of a PFilter.
+ * - SMARC_DESIGN_REMEZ : Parks-McClellan equiripple design. Shortest filters (fastest resampling)
+ *                        but the iterative design may take a while for long filters.
+ * - SMARC_DESIGN_KAISER : closed form Kaiser windowed-sinc design. Filters are somewhat longer
+ *                         for the same specification but are designed almost instantly.
+ */
+#define SMARC_DESIGN_REMEZ 0
+#define SMARC_DESIGN_KAISER 1
+
+/**
+ * Same as smarc_init_pfilter but let the user choose the filter design method.
+ * - design (IN) : SMARC_DESIGN_REMEZ or SMARC_DESIGN_KAISER
+ * smarc_init_pfilter is equivalent to smarc_init_pfilter_design with SMARC_DESIGN_REMEZ.
+ */
+struct PFilter* smarc_init_pfilter_design(int fsin, const int fsout,
+		double bandwidth, double rp, double rs,
+		double tol, const char* userratios, int searchfastconversion, int design);
+
 /**
  * release PFilter
  */
@@ -76,6 +95,13 @@ int smarc_get_fs_out(struct PFilter*);
  */
 int smarc_get_output_buffer_size(struct PFilter* pfilt,int inSize);
 
+/**
+ * return an output buffer size for smarc_resample_flush that takes the
+ * whole last stage at once. Smaller buffers work too, by calling the
+ * flush until it returns 0.
+ */
+int smarc_get_flush_buffer_size(struct PFilter* pfilt);
+
 /**
  * print PFilter informations to standard output
  */
@@ -130,6 +156,29 @@ int smarc_resample_flush(struct PFilter*, struct PState*,
 		double* output,
 		int outputLength);
 
+/**
+ * Resample a whole signal at once, splitting it into nbSegments output ranges that are
+ * processed concurrently (with OpenMP when available). Each segment gets its own PState,
+ * positioned and warmed up over the filter length of every stage, and writes a disjoint
+ * range of output. The result is identical, sample for sample, to calling smarc_resample
+ * then smarc_resample_flush on the whole signal with a fresh PState.
+ *  - pfilter [IN]: PFilter used to resample
+ *  - signal [IN]: array holding the whole signal to resample
+ *  - signalLength [IN]: length of signal to resample
+ *  - output [OUT]: buffer where to write resampled signal, at least
+ *                  smarc_get_output_buffer_size(pfilter,signalLength) long
+ *  - outputLength [IN]: size of output buffer.
+ *  - nbSegments [IN]: number of segments. Segments that would be too short to be split
+ *                     from their neighbours are merged, 1 means sequential processing.
+ * Returns the number of output samples written.
+ */
+int smarc_resample_segmented(struct PFilter* pfilter,
+		const double* signal,
+		int signalLength,
+		double* output,
+		int outputLength,
+		int nbSegments);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,11 +32,13 @@
 #include <string.h>
 
 #include "remez_lp.h"
+#include "kaiser_lp.h"
+#include "smarc.h"
 
 #define MAX_FILTER_LENGTH 8192
 
 void build_filter(double fpass, double fstop,
-		double rp, double rs, int rpFactor, double** h, int* len, int lenStep) {
+		double rp, double rs, int rpFactor, double** h, int* len, int lenStep, int design) {
 	int i;
 	double *bands, *mag, *dev, *weight;
 
@@ -58,7 +60,12 @@ void build_filter(double fpass, double fstop,
 	dev[0] = (pow(10, rp / 20.0) - 1) / (rpFactor *(pow(10, rp / 20.0) + 1));
 	dev[1] = pow(10, -rs / 20.0);
 
-	int n = remez_lp_order(bands, mag, dev, weight);
+	int n;
+	double beta = 0;
+	if (design == SMARC_DESIGN_KAISER)
+		n = kaiser_lp_order(bands, dev, &beta);
+	else
+		n = remez_lp_order(bands, mag, dev, weight);
 
 	// filter length must be 2*K*lenStep+1 so that delay is integer
 	{
@@ -72,19 +79,38 @@ void build_filter(double fpass, double fstop,
 	{
 		free(bands);
 		*len = 0;
-		printf("ERROR: cannot build remez filter, it's too long ! (%i) try with other parameters\n",n);
+		printf("ERROR: cannot build %s filter, it's too long ! (%i) try with other parameters\n",
+				(design == SMARC_DESIGN_KAISER) ? "kaiser" : "remez", n);
 		return;
 	}
 
 	*h = malloc((*len) * sizeof(double));
 	for (i = 0; i < *len; i++)
 		(*h)[i] = 0;
+	if (design == SMARC_DESIGN_KAISER)
+	{
+		kaiser_lp(*h, *len, bands, beta);
+		free(bands);
+		return;
+	}
 	int iRc = remez_lp(*h, *len, bands, mag, weight);
 	if (iRc)
 	{
+		// the exchange did not converge (e.g. very narrow passband): use the closed form design
 		free(*h);
 		*h = NULL;
 		*len = 0;
+		n = kaiser_lp_order(bands, dev, &beta);
+		if (n<=MAX_FILTER_LENGTH)
+		{
+			printf("WARNING: using kaiser design instead of remez for this stage\n");
+			int k = 1;
+			while (2*k*lenStep + 1 < n)
+				k++;
+			*len = 2*k*lenStep + 1;
+			*h = malloc((*len) * sizeof(double));
+			kaiser_lp(*h, *len, bands, beta);
+		}
 	}
 
 	free(bands);
@@ -92,12 +118,12 @@ void build_filter(double fpass, double fstop,
 
 struct PSFilter* init_psfilter(int L, int M,
 		double fpass, double fstop,
-		double rp, double rs, int rpFactor) {
+		double rp, double rs, int rpFactor, int design) {
 
 	double* h = 0;
 	int Lenh;
 
-	build_filter(fpass,fstop,rp, rs, rpFactor, &h, &Lenh,M);
+	build_filter(fpass,fstop,rp, rs, rpFactor, &h, &Lenh,M,design);
 	if (Lenh==0)
 	{
 		printf("ERROR: cannot build filter %i/%i (within a %i stage filter) with parameters fpass=%0.2f fstop=%0.2f rp=%0.2f rs=%0.2f\n",L,M,rpFactor, fpass,fstop,rp,rs);
@@ -57,12 +57,13 @@ struct PSFilter {
  * - rp [IN]: accepted ripple factor in pass band (in dB) within global structure.
  * - rs [IN]: accepted ripple factor in stop band (in dB)
  * - rpFactor [IN]: number of stage in global structure.
+ * - design [IN]: filter design method, SMARC_DESIGN_REMEZ or SMARC_DESIGN_KAISER (see smarc.h)
  *
  * Return pointer to PSFilter struct. This pointer must be deleted using destroy_psfilter function.
  */
 struct PSFilter* init_psfilter(int L, int M,
 		double fpass, double fstop,
-		double rp, double rs, int rpFactor);
+		double rp, double rs, int rpFactor, int design);
 
 /**
  * Destroy PSFilter, release memory
@@ -27,15 +27,210 @@
 #include <numeric>      //std::accumulate
 #include <functional>   // bind2nd
 #include <cmath>
+#include <cstring>
+#include <cctype>
 #include <variant>
+#include <memory>
+#include <limits>
+#include <queue>
+#include <string_view>
+#include <unordered_map>
 #include <Rcpp.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// thresholds of clock reset detection: a reset is where the interval between
+// ClockOffset measurements and the change of offset both jump far from their median
+#define RESET_THRESHOLD_STDS 5              // interval jump, in median absolute deviations
+#define RESET_THRESHOLD_SECONDS 5           // interval jump, in seconds
+#define RESET_THRESHOLD_OFFSET_STDS 10      // offset jump, in median absolute deviations
+#define RESET_THRESHOLD_OFFSET_SECONDS 1    // offset jump, in seconds
+
+namespace
+{
+    //smarc state of a stream resampled while it is being loaded
+    struct ChunkResampler
+    {
+        struct PFilter* pfilt = nullptr;
+        std::vector<struct PState*> states;   //one per channel
+        std::vector<double> input;            //decoded chunk, channel after channel
+        std::vector<double> output;
+        double t0 = 0;                        //time stamp of the first sample
+        bool started = false;
+
+        ChunkResampler() = default;
+        ChunkResampler(const ChunkResampler&) = delete;
+        ChunkResampler& operator=(const ChunkResampler&) = delete;
+        ~ChunkResampler()
+        {
+            for (auto state : states)
+                smarc_destroy_pstate(state);
+            if (pfilt)
+                smarc_destroy_pfilter(pfilt);
+        }
+    };
+
+    //median of the values, in linear time
+    double median(std::vector<double> values)
+    {
+        size_t mid = values.size() / 2;
+        std::nth_element(values.begin(), values.begin() + mid, values.end());
+        double upper = values[mid];
+        if (values.size() % 2)
+            return upper;
+        return 0.5 * (upper + *std::max_element(values.begin(), values.begin() + mid));
+    }
+
+    //add to the time stamps the clock offsets measured at times[0..count), interpolated
+    //linearly between measurements and held constant before the first and after the last
+    void applyClockOffsets(double* ts, size_t N, const double* times, const double* values, size_t count)
+    {
+        // before the first measurement, the first offset applies
+        size_t m = 0;
+        size_t end = 0;
+        while (end < N && ts[end] < times[0])
+            end++;
+        for (size_t k = m; k < end; ++k)
+            ts[k] += values[0];
+        m = end;
+
+        // between two measurements, the offset is interpolated linearly; each run
+        // of samples is a plain affine update that the compiler can vectorize
+        for (size_t j = 0; j + 1 < count && m < N; ++j)
+        {
+            while (end < N && ts[end] < times[j + 1])
+                end++;
+
+            const double t0 = times[j];
+            const double v0 = values[j];
+            const double slope = times[j + 1] > t0 ? (values[j + 1] - v0) / (times[j + 1] - t0) : 0;
+            for (size_t k = m; k < end; ++k)
+                ts[k] += v0 + slope * (ts[k] - t0);
+            m = end;
+        }
+
+        // after the last measurement, the last offset applies
+        for (size_t k = m; k < N; ++k)
+            ts[k] += values[count - 1];
+    }
+
+    //indices of times given a lower bound search: lowerBound(t, hint) is the first
+    //sample at or after hint whose time stamp is not before t, timeAt(k) its time stamp
+    template <typename LowerBound, typename TimeAt>
+    void lookupIndices(size_t n, LowerBound lowerBound, TimeAt timeAt, const double* times, size_t count,
+                       Xdf::IndexMethod method, int64_t* out)
+    {
+        const bool sorted = std::is_sorted(times, times + count);
+        size_t hint = 0;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const double t = times[i];
+            size_t k = lowerBound(t, hint);
+            if (sorted)
+                hint = k;
+
+            switch (method)
+            {
+            case Xdf::IndexMethod::Ceil:
+                out[i] = k < n ? (int64_t)k : -1;
+                break;
+            case Xdf::IndexMethod::Floor:
+                //last sample not after t: one before the first sample after t, so the
+                //last of repeated time stamps equal to t
+                out[i] = (int64_t)lowerBound(std::nextafter(t, INFINITY), k) - 1;
+                break;
+            case Xdf::IndexMethod::Nearest:
+                if (n == 0)
+                    out[i] = -1;
+                else if (k == 0)
+                    out[i] = 0;
+                else if (k == n)
+                    out[i] = n - 1;
+                else
+                    out[i] = t - timeAt(k - 1) <= timeAt(k) - t ? k - 1 : k;
+                break;
+            }
+        }
+    }
+
+    //append resampled values to a channel, converted back to the stream's channel format
+    void appendResampled(std::vector<std::variant<int, float, double, int64_t, std::string>>& row,
+                         const std::string& format, const double* values, int count)
+    {
+        if (format.compare("float32") == 0)
+            for (int k = 0; k < count; ++k)
+                row.emplace_back(static_cast<float>(values[k]));
+        else if (format.compare("double64") == 0)
+            for (int k = 0; k < count; ++k)
+                row.emplace_back(values[k]);
+        else if (format.compare("int64_t") == 0)
+            for (int k = 0; k < count; ++k)
+                row.emplace_back(static_cast<int64_t>(std::llround(values[k])));
+        else
+            for (int k = 0; k < count; ++k)
+                row.emplace_back(static_cast<int>(std::lround(values[k])));
+    }
+
+    //one channel of a chunk; each sample is a time stamp flag, an optional time stamp, then all channels
+    template <typename T>
+    void decodeValues(const char* p, uint64_t count, int channelCount, int channel, double* out)
+    {
+        for (uint64_t k = 0; k < count; k++)
+        {
+            if (*p++ == 8)
+                p += sizeof(double);
+            T value;
+            std::memcpy(&value, p + channel * sizeof(T), sizeof(T));
+            out[k] = static_cast<double>(value);
+            p += channelCount * sizeof(T);
+        }
+    }
+
+    //a stream header without its <desc> element, which holds the per-channel metadata
+    std::string headerOutline(const std::string& header)
+    {
+        size_t first = header.find("<desc");
+        while (first != std::string::npos && first + 5 < header.size() &&
+               header[first + 5] != '>' && header[first + 5] != '/' && !std::isspace((unsigned char)header[first + 5]))
+            first = header.find("<desc", first + 5);
+        size_t open = first == std::string::npos ? first : header.find('>', first);
+        if (open == std::string::npos)
+            return header;
+
+        if (header[open - 1] == '/') //<desc/>
+            return header.substr(0, first) + header.substr(open + 1);
+
+        size_t last = header.rfind("</desc>");
+        if (last == std::string::npos || last < open)
+            return header;
+        return header.substr(0, first) + header.substr(last + 7);
+    }
+}
 
 Xdf::Xdf()
 {
 }
 
+std::ostream& Xdf::messages()
+{
+    return logStream ? *logStream : Rcpp::Rcout;
+}
+
+std::ostream& Xdf::errors()
+{
+    return logStream ? *logStream : Rcpp::Rcerr;
+}
+
 int Xdf::load_xdf(std::string filename)
 {
+    return load_xdf(filename, LoadOptions());
+}
+
+int Xdf::load_xdf(std::string filename, const LoadOptions& options)
+{
+    const int userSrate = options.userSrate;
     clock_t time;
     time = clock();
 
@@ -51,6 +246,8 @@ int Xdf::load_xdf(std::string filename)
      */
 
     std::vector<int> idmap; //remaps stream id's onto indices in streams
+    std::vector<std::unique_ptr<ChunkResampler>> resamplers; //same indices as streams, null if not resampled
+    std::vector<std::pair<double, uint64_t>> anchors; //last explicit time stamp of each stream, samples since
 
 
     //===================================================================
@@ -73,7 +270,7 @@ int Xdf::load_xdf(std::string filename)
 
         if (magicNumber.compare("XDF:"))
         {
-            Rcpp::Rcout << "This is not a valid XDF file.('" << filename << "')\n";
+            messages() << "This is not a valid XDF file.('" << filename << "')\n";
             return -1;
         }
 
@@ -94,7 +291,8 @@ int Xdf::load_xdf(std::string filename)
                 {
                     char* buffer = new char[ChLen - 2];
                     file.read(buffer, ChLen - 2);
-                    fileHeader = buffer;
+                    //the chunk is not null-terminated
+                    fileHeader.assign(buffer, ChLen - 2);
 
                     pugi::xml_document doc;
 
@@ -124,39 +322,37 @@ int Xdf::load_xdf(std::string filename)
                         index = std::distance(idmap.begin(), it);
 
 
-                    pugi::xml_document doc;
-
                     //read [Content]
-                    char* buffer = new char[ChLen - 6];
-                    file.read(buffer, ChLen - 6);
-                    streams[index].streamHeader = buffer;
-
-                    doc.load_buffer_inplace(buffer, ChLen - 6);
-
-                    pugi::xml_node info = doc.child("info");
-                    pugi::xml_node desc = info.child("desc");
-
-                    streams[index].info.channel_count = info.child("channel_count").text().as_int();
-                    streams[index].info.nominal_srate = info.child("nominal_srate").text().as_double();
-                    streams[index].info.name = info.child("name").text().get();
-                    streams[index].info.type = info.child("type").text().get();
-                    streams[index].info.channel_format = info.child("channel_format").text().get();
-
-                    for (auto channel = desc.child("channels").child("channel"); channel; channel = channel.
-                         next_sibling("channel"))
+                    std::string header(ChLen - 6, '\0');
+                    file.read(&header[0], ChLen - 6);
+                    parseStreamHeader(streams[index], std::move(header));
+
+                    //numeric streams at another rate are resampled chunk by chunk while reading
+                    if (userSrate > 0 && !options.lazyValues &&
+                        streams[index].info.channel_format.compare("string") &&
+                        streams[index].info.nominal_srate != userSrate &&
+                        streams[index].info.nominal_srate != 0)
                     {
-                        streams[index].info.channels.emplace_back();
-
-                        for (auto const& entry : channel.children())
-                            streams[index].info.channels.back().emplace(entry.name(), entry.child_value());
+                        if (resamplers.size() <= (size_t)index)
+                            resamplers.resize(index + 1);
+                        if (!resamplers[index])
+                        {
+                            struct PFilter* pfilt = smarc_init_pfilter_design(
+                                streams[index].info.nominal_srate, userSrate, options.resample.bandwidth,
+                                options.resample.rp, options.resample.rs, options.resample.tol, NULL, 0,
+                                options.resample.design);
+                            if (pfilt == NULL)
+                                messages() << "Stream " << streamID << " is kept at its original sample rate.\n";
+                            else
+                            {
+                                resamplers[index].reset(new ChunkResampler);
+                                resamplers[index]->pfilt = pfilt;
+                                for (int v = 0; v < streams[index].info.channel_count; ++v)
+                                    resamplers[index]->states.emplace_back(smarc_init_pstate(pfilt));
+                            }
+                        }
                     }
 
-                    if (streams[index].info.nominal_srate > 0)
-                        streams[index].sampling_interval = 1 / streams[index].info.nominal_srate;
-                    else
-                        streams[index].sampling_interval = 0;
-
-                    delete[] buffer;
                 }
                 break;
               // In the [Samples] chunk case (case 3), modify the data reading section:
@@ -180,11 +376,30 @@ int Xdf::load_xdf(std::string filename)
                   //read [NumSampleBytes], [NumSamples]
                   uint64_t numSamp = readLength(file);
                   
-                  //if the time series is empty, initialize it
-                  if (streams[index].time_series.empty())
+                  //values of a lazy stream stay in the file; only where the chunk is gets recorded
+                  const bool lazy = options.lazyValues && streams[index].info.channel_format.compare("string");
+                  const int valueBytes = lazy ? streams[index].info.channel_count *
+                      formatSize(streams[index].info.channel_format) : 0;
+                  if (lazy)
+                  {
+                    auto& chunks = streams[index].sample_chunks;
+                    uint64_t first = chunks.empty() ? 0 : chunks.back().first + chunks.back().count;
+                    chunks.push_back({ (uint64_t)file.tellg(), first, numSamp });
+                  }
+
+                  //if the time series is empty, initialize it; string streams go to the arena
+                  if (streams[index].time_series.empty() && streams[index].info.channel_format.compare("string") &&
+                      !lazy)
                   {
                     streams[index].time_series.resize(streams[index].info.channel_count);
                   }
+                  if (anchors.size() <= (size_t)index)
+                    anchors.resize(index + 1, std::make_pair(0.0, (uint64_t)0));
+
+                  //decoded values of a resampled stream are collected per channel, not stored
+                  ChunkResampler* resampler = (size_t)index < resamplers.size() ? resamplers[index].get() : nullptr;
+                  if (resampler)
+                    resampler->input.resize(streams[index].info.channel_count * numSamp);
                   
                   //for each sample
                   for (size_t i = 0; i < numSamp; i++)
@@ -197,26 +412,40 @@ int Xdf::load_xdf(std::string filename)
                     if (tsBytes == 8)
                     {
                       Xdf::readBin(file, &ts);
-                      streams[index].time_stamps.emplace_back(ts);
+                      anchors[index] = std::make_pair(ts, 0);
+                    }
+                    else if (streams[index].info.nominal_srate > 0)
+                    {
+                      //counted from the last explicit time stamp, so that the deduced ones lie
+                      //exactly on a line and compact well (see CompactTimeStamps)
+                      ts = anchors[index].first + (double)(++anchors[index].second) / streams[index].info.nominal_srate;
                     }
                     else
                     {
-                      ts = streams[index].last_timestamp + streams[index].sampling_interval;
+                      ts = streams[index].last_timestamp;
+                    }
+                    
+                    //a resampled stream only needs its first time stamp
+                    if (resampler == nullptr)
                       streams[index].time_stamps.emplace_back(ts);
+                    else if (!resampler->started)
+                    {
+                      resampler->t0 = ts;
+                      resampler->started = true;
                     }
                     
                     streams[index].last_timestamp = ts;
                     
-                    if (streams[index].info.channel_format.compare("string") == 0)
+                    if (lazy)
+                    {
+                      file.seekg(valueBytes, std::ios::cur);
+                    }
+                    else if (streams[index].info.channel_format.compare("string") == 0)
                     {
                       for (int v = 0; v < streams[index].info.channel_count; ++v)
                       {
                         auto length = Xdf::readLength(file);
-                        char* buffer = new char[length + 1];
-                        file.read(buffer, length);
-                        buffer[length] = '\0';
-                        streams[index].time_series[v].emplace_back(std::string(buffer));
-                        delete[] buffer;
+                        file.read(streams[index].string_series.append(length), length);
                       }
                     }
                     else
@@ -228,7 +457,10 @@ int Xdf::load_xdf(std::string filename)
                         {
                           float data;
                           Xdf::readBin(file, &data);
-                          streams[index].time_series[v].emplace_back(data);
+                          if (resampler)
+                            resampler->input[v * numSamp + i] = static_cast<double>(data);
+                          else
+                            streams[index].time_series[v].emplace_back(data);
                         }
                       }
                       else if (streams[index].info.channel_format.compare("double64") == 0)
@@ -237,7 +469,10 @@ int Xdf::load_xdf(std::string filename)
                         {
                           double data;
                           Xdf::readBin(file, &data);
-                          streams[index].time_series[v].emplace_back(data);
+                          if (resampler)
+                            resampler->input[v * numSamp + i] = static_cast<double>(data);
+                          else
+                            streams[index].time_series[v].emplace_back(data);
                         }
                       }
                       else if (streams[index].info.channel_format.compare("int8_t") == 0)
@@ -246,7 +481,10 @@ int Xdf::load_xdf(std::string filename)
                         {
                           int8_t data;
                           Xdf::readBin(file, &data);
-                          streams[index].time_series[v].emplace_back(static_cast<int>(data));
+                          if (resampler)
+                            resampler->input[v * numSamp + i] = static_cast<double>(data);
+                          else
+                            streams[index].time_series[v].emplace_back(static_cast<int>(data));
                         }
                       }
                       else if (streams[index].info.channel_format.compare("int16_t") == 0)
@@ -255,7 +493,10 @@ int Xdf::load_xdf(std::string filename)
                         {
                           int16_t data;
                           Xdf::readBin(file, &data);
-                          streams[index].time_series[v].emplace_back(static_cast<int>(data));
+                          if (resampler)
+                            resampler->input[v * numSamp + i] = static_cast<double>(data);
+                          else
+                            streams[index].time_series[v].emplace_back(static_cast<int>(data));
                         }
                       }
                       else if (streams[index].info.channel_format.compare("int32_t") == 0)
@@ -264,7 +505,10 @@ int Xdf::load_xdf(std::string filename)
                         {
                           int32_t data;
                           Xdf::readBin(file, &data);
-                          streams[index].time_series[v].emplace_back(data);
+                          if (resampler)
+                            resampler->input[v * numSamp + i] = static_cast<double>(data);
+                          else
+                            streams[index].time_series[v].emplace_back(data);
                         }
                       }
                       else if (streams[index].info.channel_format.compare("int64_t") == 0)
@@ -273,11 +517,27 @@ int Xdf::load_xdf(std::string filename)
                         {
                           int64_t data;
                           Xdf::readBin(file, &data);
-                          streams[index].time_series[v].emplace_back(data);
+                          if (resampler)
+                            resampler->input[v * numSamp + i] = static_cast<double>(data);
+                          else
+                            streams[index].time_series[v].emplace_back(data);
                         }
                       }
                     }
                   }
+                  
+                  if (resampler)
+                  {
+                    resampler->output.resize(smarc_get_output_buffer_size(resampler->pfilt, numSamp));
+                    for (int v = 0; v < streams[index].info.channel_count; ++v)
+                    {
+                      int written = smarc_resample(resampler->pfilt, resampler->states[v],
+                                                   &resampler->input[v * numSamp], numSamp,
+                                                   resampler->output.data(), (int)resampler->output.size());
+                      appendResampled(streams[index].time_series[v], streams[index].info.channel_format,
+                                      resampler->output.data(), written);
+                    }
+                  }
                 }
               break;
             case 4: //read [ClockOffset] chunk
@@ -325,11 +585,11 @@ int Xdf::load_xdf(std::string filename)
                         index = std::distance(idmap.begin(), it);
 
 
-                    char* buffer = new char[ChLen - 6];
-                    file.read(buffer, ChLen - 6);
-                    streams[index].streamFooter = buffer;
+                    std::string& footer = streams[index].streamFooter;
+                    footer.resize(ChLen - 6);
+                    file.read(&footer[0], ChLen - 6);
 
-                    doc.load_buffer_inplace(buffer, ChLen - 6);
+                    doc.load_buffer(footer.data(), footer.size(), pugi::parse_minimal);
 
                     pugi::xml_node info = doc.child("info");
 
@@ -337,23 +597,48 @@ int Xdf::load_xdf(std::string filename)
                     streams[index].info.last_timestamp = info.child("last_timestamp").text().as_double();
                     streams[index].info.measured_srate = info.child("measured_srate").text().as_double();
                     streams[index].info.sample_count = info.child("sample_count").text().as_int();
-                    delete[] buffer;
                 }
                 break;
             case 5: //skip other chunk types (Boundary, ...)
                 file.seekg(ChLen - 2, file.cur);
                 break;
             default:
-                Rcpp::Rcout << "Unknown chunk encountered.\n";
+                messages() << "Unknown chunk encountered.\n";
                 break;
             }
         }
 
 
+        //flush the resampled streams and give them their new time stamps
+        std::vector<size_t> resampled;
+        for (size_t k = 0; k < resamplers.size(); ++k)
+        {
+            ChunkResampler* resampler = resamplers[k].get();
+            if (resampler == nullptr)
+                continue;
+            resampled.emplace_back(k);
+
+            resampler->output.resize(std::max(smarc_get_output_buffer_size(resampler->pfilt, 0),
+                                              smarc_get_flush_buffer_size(resampler->pfilt)));
+            for (size_t v = 0; v < streams[k].time_series.size(); ++v)
+            {
+                //the flush resumes where it stopped when the buffer fills up
+                int written;
+                while ((written = smarc_resample_flush(resampler->pfilt, resampler->states[v],
+                                                       resampler->output.data(),
+                                                       (int)resampler->output.size())) > 0)
+                    appendResampled(streams[k].time_series[v], streams[k].info.channel_format,
+                                    resampler->output.data(), written);
+            }
+            size_t length = streams[k].time_series.empty() ? 0 : streams[k].time_series.front().size();
+            setUniformTimeStamps(streams[k], resampler->t0, userSrate, length);
+        }
+        resamplers.clear();
+
         //calculate how much time it takes to read the data
         clock_t halfWay = clock() - time;
 
-        Rcpp::Rcout << "it took " << halfWay << " clicks (" << ((float)halfWay) / CLOCKS_PER_SEC << " seconds)"
+        messages() << "it took " << halfWay << " clicks (" << ((float)halfWay) / CLOCKS_PER_SEC << " seconds)"
             << " reading XDF data" << std::endl;
 
 
@@ -363,6 +648,19 @@ int Xdf::load_xdf(std::string filename)
 
         syncTimeStamps();
 
+        //as with resample() after loading, resampled streams are uniform from their synced first sample
+        for (size_t k : resampled)
+        {
+            if (!streams[k].time_stamps.empty())
+                setUniformTimeStamps(streams[k], streams[k].time_stamps.front(), userSrate,
+                                     streams[k].time_stamps.size());
+        }
+
+        if (options.dejitter)
+            dejitterTimeStamps(options.breakThresholdSeconds, options.breakThresholdSamples);
+
+        buildEventIndex();
+
         findMinMax();
 
         findMajSR();
@@ -377,12 +675,18 @@ int Xdf::load_xdf(std::string filename)
 
         calcEffectiveSrate();
 
+        if (userSrate > 0)
+        {
+            calcTotalLength(userSrate);
+            adjustTotalLength();
+        }
+
         //loading finishes, close file
         file.close();
     }
     else
     {
-        Rcpp::Rcout << "Unable to open file" << std::endl;
+        messages() << "Unable to open file" << std::endl;
         return 1;
     }
 
@@ -391,136 +695,415 @@ int Xdf::load_xdf(std::string filename)
 
 void Xdf::syncTimeStamps()
 {
-    // Sync time stamps
-    for (auto& stream : this->streams)
+    // Split the clock offsets at clock resets, then sync time stamps, one stream per thread.
+    // Events are taken from the synced time stamps of string streams afterwards.
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < (int)this->streams.size(); k++)
+    {
+        if (!this->streams[k].clock_times.empty())
+            syncStreamTimeStamps(this->streams[k], findClockResets(this->streams[k]));
+    }
+
+    // Update first and last time stamps in stream footer; those of string
+    // streams come from their events, see buildEventIndex()
+    for (size_t k = 0; k < this->streams.size(); k++)
     {
-        if (!stream.clock_times.empty())
+        if (streams[k].info.channel_format.compare("string") && streams[k].time_stamps.size() > 0)
         {
-            size_t m = 0; // index iterating through stream.time_stamps
-            size_t n = 0; // index iterating through stream.clock_times
+            streams[k].info.first_timestamp = streams[k].time_stamps.front();
+            streams[k].info.last_timestamp = streams[k].time_stamps.back();
+        }
+    }
+}
 
-            while (m < stream.time_stamps.size())
-            {
-                if (stream.clock_times[n] < stream.time_stamps[m])
-                {
-                    while (n < stream.clock_times.size() - 1 && stream.clock_times[n + 1] < stream.time_stamps[m])
-                    {
-                        n++;
-                    }
-                    stream.time_stamps[m] += stream.clock_values[n];
-                }
-                else if (n == 0)
-                {
-                    stream.time_stamps[m] += stream.clock_values[n];
-                }
-                m++;
-            }
+void Xdf::buildEventIndex()
+{
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < (int)this->streams.size(); k++)
+    {
+        if (this->streams[k].info.channel_format.compare("string") == 0)
+            indexStreamEvents(this->streams[k]);
+    }
+
+    // merge the sorted events of all streams into eventMap
+    size_t total = 0;
+    for (auto const& stream : streams)
+        total += stream.events.size();
+    eventMap.clear();
+    eventMap.reserve(total);
+
+    typedef std::pair<double, size_t> Head; // time stamp of the next event of a stream, stream index
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    std::vector<size_t> next(streams.size(), 0);
+    for (size_t k = 0; k < streams.size(); k++)
+        if (!streams[k].events.empty())
+            heads.emplace(streams[k].events.front().timestamp, k);
+
+    while (!heads.empty())
+    {
+        size_t k = heads.top().second;
+        heads.pop();
+
+        const Event& event = streams[k].events[next[k]++];
+        const size_t value = event.sample * streams[k].info.channel_count + event.channel;
+        eventMap.emplace_back(std::make_pair(std::string(streams[k].string_series.at(value)), event.timestamp), (int)k);
+
+        if (next[k] < streams[k].events.size())
+            heads.emplace(streams[k].events[next[k]].timestamp, k);
+    }
+}
+
+void Xdf::indexStreamEvents(Stream& stream)
+{
+    stream.events.clear();
+    const size_t channels = stream.info.channel_count;
+    const size_t samples = channels ? std::min(stream.string_series.size() / channels, stream.time_stamps.size()) : 0;
+    stream.events.reserve(samples * channels);
+
+    for (size_t m = 0; m < samples; m++)
+        for (size_t v = 0; v < channels; v++)
+            stream.events.push_back({ stream.time_stamps[m], m, (int)v });
+
+    // time stamps are nearly always in order already
+    auto earlier = [](const Event& a, const Event& b) { return a.timestamp < b.timestamp; };
+    if (!std::is_sorted(stream.events.begin(), stream.events.end(), earlier))
+        std::stable_sort(stream.events.begin(), stream.events.end(), earlier);
+
+    stream.info.first_timestamp = stream.events.empty() ? NAN : stream.events.front().timestamp;
+    stream.info.last_timestamp = stream.events.empty() ? NAN : stream.events.back().timestamp;
+}
+
+void Xdf::decodeChunk(const char* chunk, uint64_t count, int channelCount, const std::string& format,
+                      int channel, double* out)
+{
+    if (format.compare("float32") == 0)
+        decodeValues<float>(chunk, count, channelCount, channel, out);
+    else if (format.compare("double64") == 0)
+        decodeValues<double>(chunk, count, channelCount, channel, out);
+    else if (format.compare("int8_t") == 0)
+        decodeValues<int8_t>(chunk, count, channelCount, channel, out);
+    else if (format.compare("int16_t") == 0)
+        decodeValues<int16_t>(chunk, count, channelCount, channel, out);
+    else if (format.compare("int32_t") == 0)
+        decodeValues<int32_t>(chunk, count, channelCount, channel, out);
+    else if (format.compare("int64_t") == 0)
+        decodeValues<int64_t>(chunk, count, channelCount, channel, out);
+}
+
+void Xdf::dejitterTimeStamps(double breakThresholdSeconds, double breakThresholdSamples)
+{
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < (int)this->streams.size(); k++)
+    {
+        if (this->streams[k].info.nominal_srate > 0 && !this->streams[k].time_stamps.empty())
+            dejitterStream(this->streams[k], breakThresholdSeconds, breakThresholdSamples);
+    }
+}
+
+void Xdf::dejitterStream(Stream& stream, double breakThresholdSeconds, double breakThresholdSamples)
+{
+    std::vector<double>& ts = stream.time_stamps;
+    const size_t N = ts.size();
+    const double nominal = stream.info.nominal_srate;
+    const double threshold = std::max(breakThresholdSeconds, breakThresholdSamples / nominal);
+
+    stream.compact_time_stamps = CompactTimeStamps();
+
+    size_t first = 0;
+    while (first < N)
+    {
+        // a segment ends at a jump larger than the threshold, forwards or backwards;
+        // small backward steps are ordinary jitter
+        size_t end = first + 1;
+        while (end < N && std::abs(ts[end] - ts[end - 1]) <= threshold)
+            end++;
+
+        // least-squares line through the segment, with the sample index centered so
+        // that its sum vanishes and sum(k^2) = n(n^2 - 1)/12; times are taken
+        // relative to the first one to keep the sums small
+        const size_t n = end - first;
+        const double tFirst = ts[first];
+        const double kMean = 0.5 * (double)(n - 1);
+        double sumT = 0;
+        double sumKT = 0;
+        for (size_t k = 0; k < n; ++k)
+        {
+            const double t = ts[first + k] - tFirst;
+            sumT += t;
+            sumKT += ((double)k - kMean) * t;
         }
+
+        TimeStampSegment segment;
+        segment.first = first;
+        segment.count = n;
+        segment.srate = nominal;
+        if (n > 1)
+        {
+            const double sumKK = (double)n * ((double)n * n - 1) / 12;
+            const double slope = sumKT / sumKK;
+            if (slope > 0)
+                segment.srate = 1 / slope;
+        }
+        segment.t0 = tFirst + sumT / n - kMean / segment.srate;
+
+        for (size_t k = 0; k < n; ++k)
+            ts[first + k] = segment.t0 + (double)k / segment.srate;
+
+        stream.compact_time_stamps.segments.emplace_back(segment);
+        first = end;
+    }
+
+    stream.info.first_timestamp = ts.front();
+    stream.info.last_timestamp = ts.back();
+}
+
+std::vector<std::pair<size_t, size_t>> Xdf::findClockResets(const Stream& stream)
+{
+    const std::vector<double>& times = stream.clock_times;
+    const std::vector<double>& values = stream.clock_values;
+    const size_t n = times.size();
+    std::vector<std::pair<size_t, size_t>> ranges;
+
+    if (n < 3)
+    {
+        ranges.emplace_back(0, n);
+        return ranges;
     }
 
-    // Sync event time stamps
-    for (auto& elem : this->eventMap)
+    // typical interval between measurements and typical change of offset, with
+    // their median absolute deviations
+    std::vector<double> timeDiff(n - 1);
+    std::vector<double> valueDiff(n - 1);
+    for (size_t i = 0; i + 1 < n; ++i)
+    {
+        timeDiff[i] = times[i + 1] - times[i];
+        valueDiff[i] = std::abs(values[i + 1] - values[i]);
+    }
+    const double medianInterval = median(timeDiff);
+    const double medianStep = median(valueDiff);
+
+    std::vector<double> deviation(n - 1);
+    for (size_t i = 0; i + 1 < n; ++i)
+        deviation[i] = std::abs(timeDiff[i] - medianInterval);
+    const double intervalMad = median(deviation) + std::numeric_limits<double>::epsilon();
+    for (size_t i = 0; i + 1 < n; ++i)
+        deviation[i] = std::abs(valueDiff[i] - medianStep);
+    const double stepMad = median(deviation) + std::numeric_limits<double>::epsilon();
+
+    // a reset is a glitch in both the measurement times and the offset values
+    size_t begin = 0;
+    for (size_t i = 0; i + 1 < n; ++i)
     {
-        if (!this->streams[elem.second].clock_times.empty())
+        const double interval = timeDiff[i] - medianInterval;
+        const double step = valueDiff[i] - medianStep;
+        const bool timeGlitch = timeDiff[i] < 0 ||
+            (interval / intervalMad > RESET_THRESHOLD_STDS && interval > RESET_THRESHOLD_SECONDS);
+        const bool valueGlitch =
+            step / stepMad > RESET_THRESHOLD_OFFSET_STDS && step > RESET_THRESHOLD_OFFSET_SECONDS;
+
+        if (timeGlitch && valueGlitch)
         {
-            size_t k = 0; // index iterating through streams[elem.second].clock_times
+            ranges.emplace_back(begin, i + 1);
+            begin = i + 1;
+        }
+    }
+    ranges.emplace_back(begin, n);
+
+    return ranges;
+}
+
+void Xdf::syncStreamTimeStamps(Stream& stream, const std::vector<std::pair<size_t, size_t>>& ranges)
+{
+    std::vector<double>& ts = stream.time_stamps;
+    const size_t N = ts.size();
+
+    //a compact form built while reading describes the time stamps before sync
+    stream.compact_time_stamps = CompactTimeStamps();
+
+    if (ranges.size() == 1)
+    {
+        applyClockOffsets(ts.data(), N, stream.clock_times.data(), stream.clock_values.data(),
+                          stream.clock_times.size());
+        return;
+    }
 
-            while (k < this->streams[elem.second].clock_times.size() - 1)
+    // the sample clock restarts along with the offsets, so the samples are split
+    // where time jumps backwards
+    std::vector<size_t> starts{ 0 };
+    for (size_t k = 1; k < N; ++k)
+        if (ts[k] < ts[k - 1] - RESET_THRESHOLD_SECONDS)
+            starts.emplace_back(k);
+    starts.emplace_back(N);
+
+    // pair sample runs with offset ranges in order when they match, otherwise
+    // give each run the next range whose measurements span its first sample
+    size_t r = 0;
+    for (size_t s = 0; s + 1 < starts.size(); ++s)
+    {
+        if (starts.size() - 1 == ranges.size())
+            r = s;
+        else if (starts[s] < N)
+        {
+            const double t = ts[starts[s]];
+            for (size_t i = r; i < ranges.size(); ++i)
             {
-                if (this->streams[elem.second].clock_times[k + 1] < elem.first.second)
-                {
-                    k++;
-                }
-                else
+                if (stream.clock_times[ranges[i].first] <= t && t <= stream.clock_times[ranges[i].second - 1])
                 {
+                    r = i;
                     break;
                 }
             }
-
-            elem.first.second += this->streams[elem.second].clock_values[k];
-            // apply the last offset value to the timestamp; if there hasn't yet been an offset value take the first recorded one
         }
+
+        applyClockOffsets(ts.data() + starts[s], starts[s + 1] - starts[s],
+                          stream.clock_times.data() + ranges[r].first,
+                          stream.clock_values.data() + ranges[r].first,
+                          ranges[r].second - ranges[r].first);
     }
+}
 
-    // Update first and last time stamps in stream footer
-    for (size_t k = 0; k < this->streams.size(); k++)
+void Xdf::timeToIndex(const double* timeStamps, size_t n, const double* times, size_t count, IndexMethod method,
+                      int64_t* out)
+{
+    auto lowerBound = [timeStamps, n](double t, size_t hint)
     {
-        if (streams[k].info.channel_format.compare("string") == 0)
-        {
-            double min = NAN;
-            double max = NAN;
+        return (size_t)(std::lower_bound(timeStamps + hint, timeStamps + n, t) - timeStamps);
+    };
+    auto timeAt = [timeStamps](size_t k) { return timeStamps[k]; };
+    lookupIndices(n, lowerBound, timeAt, times, count, method, out);
+}
 
-            for (auto const& elem : this->eventMap)
-            {
-                if (elem.second == (int)k)
-                {
-                    if (std::isnan(min) || elem.first.second < min)
-                    {
-                        min = elem.first.second;
-                    }
+void Xdf::timeToIndex(const Stream& stream, const double* times, size_t count, IndexMethod method, int64_t* out)
+{
+    if (!stream.time_stamps.empty() || stream.compact_time_stamps.empty())
+    {
+        timeToIndex(stream.time_stamps.data(), stream.time_stamps.size(), times, count, method, out);
+        return;
+    }
 
-                    if (std::isnan(max) || elem.first.second > max)
-                    {
-                        max = elem.first.second;
-                    }
-                }
-            }
+    const CompactTimeStamps& compact = stream.compact_time_stamps;
+    const size_t n = compact.size();
+    auto timeAt = [&compact](size_t k) { return compact.at(k); };
 
-            streams[k].info.first_timestamp = min;
-            streams[k].info.last_timestamp = max;
-        }
-        else
+    if (!compact.exceptions.empty())
+    {
+        // plain binary search over the recovered time stamps
+        auto lowerBound = [&compact, n](double t, size_t hint)
         {
-            if (streams[k].time_stamps.size() > 0)
+            size_t lo = hint;
+            size_t hi = n;
+            while (lo < hi)
             {
-                streams[k].info.first_timestamp = streams[k].time_stamps.front();
-                streams[k].info.last_timestamp = streams[k].time_stamps.back();
+                size_t mid = lo + (hi - lo) / 2;
+                if (compact.at(mid) < t)
+                    lo = mid + 1;
+                else
+                    hi = mid;
             }
-        }
+            return lo;
+        };
+        lookupIndices(n, lowerBound, timeAt, times, count, method, out);
+        return;
+    }
+
+    // find the last segment starting at or before t, then compute the index inside it
+    auto lowerBound = [&compact](double t, size_t)
+    {
+        const std::vector<TimeStampSegment>& segments = compact.segments;
+        auto it = std::upper_bound(segments.begin(), segments.end(), t,
+                                   [](double time, const TimeStampSegment& s) { return time < s.t0; });
+        if (it == segments.begin())
+            return (size_t)0;
+
+        const TimeStampSegment& segment = *(it - 1);
+        auto timeIn = [&segment](size_t k) { return segment.t0 + (double)k / segment.srate; };
+        double x = std::ceil((t - segment.t0) * segment.srate);
+        size_t k = x <= 0 ? 0 : (size_t)std::min(x, (double)segment.count);
+
+        // the time stamps are rounded, so the estimate can be one sample off
+        while (k > 0 && timeIn(k - 1) >= t)
+            k--;
+        while (k < segment.count && timeIn(k) < t)
+            k++;
+        return segment.first + k;
+    };
+    lookupIndices(n, lowerBound, timeAt, times, count, method, out);
+}
+
+int64_t Xdf::timeToIndex(const Stream& stream, double time, IndexMethod method)
+{
+    int64_t index;
+    timeToIndex(stream, &time, 1, method, &index);
+    return index;
+}
+
+Xdf::ResampleOptions Xdf::ResampleOptions::preset(ResampleQuality quality)
+{
+    ResampleOptions options;
+
+    switch (quality)
+    {
+    case ResampleQuality::Draft:
+        options.bandwidth = 0.8;
+        options.rp = 0.5;
+        options.rs = 60;
+        options.design = SMARC_DESIGN_KAISER;
+        break;
+    case ResampleQuality::Standard:
+        options.bandwidth = 0.9;
+        options.rp = 0.1;
+        options.rs = 100;
+        options.design = SMARC_DESIGN_REMEZ;
+        break;
+    case ResampleQuality::Archival:
+        break;
     }
+
+    return options;
 }
 
 void Xdf::resample(int userSrate)
+{
+    resample(userSrate, ResampleOptions());
+}
+
+void Xdf::resample(int userSrate, const ResampleOptions& options)
 {
     //if user entered a preferred sample rate, we resample all the channels to that sample rate
     //Otherwise, we resample all channels to the sample rate that has the most channels
 
     clock_t time = clock();
 
-#define BUF_SIZE 8192
+#define MIN_SEGMENT_SIZE 65536 // shortest channel segment worth a thread of its own
+    // buffers reused by every channel; they only grow, so no allocation per row
+    std::vector<double> inbuf;
+    std::vector<double> outbuf;
+
     for (auto& stream : streams)
     {
         if (!stream.time_series.empty() &&
-            !stream.info.channel_format.compare("string") &&
+            stream.info.channel_format.compare("string") &&
             stream.info.nominal_srate != userSrate &&
             stream.info.nominal_srate != 0)
         {
             int fsin = stream.info.nominal_srate; // input samplerate
             int fsout = userSrate; // output samplerate
-            double bandwidth = 0.95; // bandwidth
-            double rp = 0.1; // passband ripple factor
-            double rs = 140; // stopband attenuation
-            double tol = 0.000001; // tolerance
 
             // initialize smarc filter
-            struct PFilter* pfilt = smarc_init_pfilter(fsin, fsout, bandwidth, rp,
-                                                       rs, tol, NULL, 0);
+            struct PFilter* pfilt = smarc_init_pfilter_design(fsin, fsout, options.bandwidth, options.rp,
+                                                              options.rs, options.tol, NULL, 0, options.design);
             if (pfilt == NULL)
                 continue;
 
-            // initialize smarc filter state
-            struct PState* pstate = smarc_init_pstate(pfilt);
-
+            int written = 0;
             for (auto& row : stream.time_series)
             {
-                // initialize buffers
-                int read = 0;
-                int written = 0;
-                const int OUT_BUF_SIZE = (int)smarc_get_output_buffer_size(pfilt, row.size());
-                double* inbuf = new double[row.size()];
-                double* outbuf = new double[OUT_BUF_SIZE];
+                if (row.empty())
+                    continue;
 
                 // Fill inbuf with the numeric values from the row
+                int read = 0;
+                inbuf.resize(row.size());
                 for (auto& val : row)
                 {
                     std::visit([&inbuf, &read](auto&& arg)
@@ -532,55 +1115,41 @@ void Xdf::resample(int userSrate)
                         }
                     }, val);
                 }
-                // resample signal block
-                written = smarc_resample(pfilt, pstate, inbuf, read, outbuf, OUT_BUF_SIZE);
-
-                // Replace original values with the resampled output
-                read = 0;
-                for (auto& val : row)
-                {
-                    // Only replace numeric values
-                    std::visit([&outbuf, &read](auto&& arg)
-                    {
-                        using T = std::decay_t<decltype(arg)>;
-                        if constexpr (std::is_arithmetic_v<T>)
-                        {
-                            arg = static_cast<T>(outbuf[read++]);
-                        }
-                    }, val);
-                }
-
-                // flushing last values
-                written = smarc_resample_flush(pfilt, pstate, outbuf, OUT_BUF_SIZE);
-
-                // Add any remaining flushed values
-                read = 0;
-                for (auto& val : row)
+                outbuf.resize(smarc_get_output_buffer_size(pfilt, read));
+
+                // resample the whole channel, split into segments processed in parallel
+                // when it is long enough (the output is the same as a sequential run)
+                int segments = 1;
+#ifdef _OPENMP
+                segments = std::max(1, std::min(omp_get_max_threads(), read / MIN_SEGMENT_SIZE));
+#endif
+                written = smarc_resample_segmented(pfilt, inbuf.data(), read, outbuf.data(), (int)outbuf.size(),
+                                                   segments);
+
+                // The row now holds the resampled output, keeping the channel's value type.
+                // Resizing in place reuses the row's storage when downsampling.
+                std::visit([&row, &outbuf, written](auto&& first)
                 {
-                    // Only replace numeric values
-                    std::visit([&outbuf, &read](auto&& arg)
+                    using T = std::decay_t<decltype(first)>;
+                    if constexpr (std::is_arithmetic_v<T>)
                     {
-                        using T = std::decay_t<decltype(arg)>;
-                        if constexpr (std::is_arithmetic_v<T>)
+                        row.resize(written);
+                        for (int k = 0; k < written; ++k)
                         {
-                            arg = static_cast<T>(outbuf[read++]);
+                            if constexpr (std::is_integral_v<T>)
+                                row[k] = static_cast<T>(std::llround(outbuf[k]));
+                            else
+                                row[k] = static_cast<T>(outbuf[k]);
                         }
-                    }, val);
-                }
-
-                // you are done with converting your signal.
-                // If you want to reuse the same converter to process another signal
-                // just reset the state:
-                smarc_reset_pstate(pstate, pfilt);
-
-                delete[] inbuf;
-                delete[] outbuf;
+                    }
+                }, row.front());
             }
-            // release smarc filter state
-            smarc_destroy_pstate(pstate);
-
             // release smarc filter
             smarc_destroy_pfilter(pfilt);
+
+            // The output is delay-compensated, so it starts at the first input sample
+            double t0 = stream.time_stamps.empty() ? stream.info.first_timestamp : stream.time_stamps.front();
+            setUniformTimeStamps(stream, t0, fsout, written);
         }
     }
     //resampling finishes here
@@ -597,10 +1166,36 @@ void Xdf::resample(int userSrate)
 
     time = clock() - time;
 
-    Rcpp::Rcout << "it took " << time << " clicks (" << ((float)time) / CLOCKS_PER_SEC << " seconds)"
+    messages() << "it took " << time << " clicks (" << ((float)time) / CLOCKS_PER_SEC << " seconds)"
         << " resampling" << std::endl;
 }
 
+void Xdf::setUniformTimeStamps(Stream& stream, double t0, int srate, size_t length)
+{
+    TimeStampSegment segment;
+    segment.first = 0;
+    segment.count = length;
+    segment.t0 = t0;
+    segment.srate = srate;
+    stream.compact_time_stamps = CompactTimeStamps();
+    if (length > 0)
+        stream.compact_time_stamps.segments.emplace_back(segment);
+
+    stream.time_stamps.resize(length);
+    stream.compact_time_stamps.expand(stream.time_stamps.data());
+
+    stream.info.nominal_srate = srate;
+    stream.sampling_interval = 1.0 / srate;
+    stream.info.sample_count = length;
+    stream.info.effective_sample_rate = srate;
+    if (length > 0)
+    {
+        stream.info.first_timestamp = stream.time_stamps.front();
+        stream.info.last_timestamp = stream.time_stamps.back();
+        stream.last_timestamp = stream.time_stamps.back();
+    }
+}
+
 //function of reading the length of each chunk
 uint64_t Xdf::readLength(std::ifstream& file)
 {
@@ -620,7 +1215,7 @@ uint64_t Xdf::readLength(std::ifstream& file)
         length = readBin<uint64_t>(file);
         break;
     default:
-        Rcpp::Rcout << "Invalid variable-length integer length ("
+        messages() << "Invalid variable-length integer length ("
             << static_cast<int>(bytes) << ") encountered.\n";
         return 0;
     }
@@ -709,7 +1304,8 @@ void Xdf::calcTotalChannel()
     //calculating total channel count, and indexing them onto streamMap
     for (size_t c = 0; c < streams.size(); c++)
     {
-        if (!streams[c].time_series.empty())
+        if (!streams[c].time_series.empty() || !streams[c].string_series.empty() ||
+            !streams[c].sample_chunks.empty())
         {
             totalCh += streams[c].info.channel_count;
 
@@ -724,24 +1320,216 @@ void Xdf::calcTotalLength(int sampleRate)
     totalLen = (maxTS - minTS) * sampleRate;
 }
 
+void Xdf::parseStreamHeader(Stream& stream, std::string header)
+{
+    stream.streamHeader = std::move(header);
+
+    //decoding only needs a few fields of <info>; the channel metadata
+    //in <desc> is parsed on first use, see channelInfo()
+    std::string outline = headerOutline(stream.streamHeader);
+    pugi::xml_document doc;
+    doc.load_buffer_inplace(&outline[0], outline.size(), pugi::parse_minimal | pugi::parse_escapes);
+
+    pugi::xml_node info = doc.child("info");
+
+    stream.info.channel_count = info.child("channel_count").text().as_int();
+    stream.info.nominal_srate = info.child("nominal_srate").text().as_double();
+    stream.info.name = info.child("name").text().get();
+    stream.info.type = info.child("type").text().get();
+    stream.info.channel_format = info.child("channel_format").text().get();
+    stream.info.channels.clear();
+    stream.info.channels_parsed = false;
+
+    if (stream.info.nominal_srate > 0)
+        stream.sampling_interval = 1 / stream.info.nominal_srate;
+    else
+        stream.sampling_interval = 0;
+}
+
+const Xdf::ChannelTable& Xdf::channelInfo(Stream& stream)
+{
+    if (!stream.info.channels_parsed)
+    {
+        pugi::xml_document doc;
+        doc.load_buffer(stream.streamHeader.data(), stream.streamHeader.size());
+
+        stream.info.channels.clear();
+        for (auto channel = doc.child("info").child("desc").child("channels").child("channel"); channel;
+             channel = channel.next_sibling("channel"))
+        {
+            stream.info.channels.addRow();
+
+            for (auto const& entry : channel.children())
+                stream.info.channels.set(entry.name(), entry.child_value());
+        }
+        stream.info.channels_parsed = true;
+    }
+    return stream.info.channels;
+}
+
+void Xdf::ChannelTable::clear()
+{
+    keys.clear();
+    values.clear();
+    present.clear();
+    columns.clear();
+    rows = 0;
+}
+
+void Xdf::ChannelTable::addRow()
+{
+    rows++;
+    for (size_t k = 0; k < keys.size(); k++)
+    {
+        values[k].emplace_back();
+        present[k].push_back(false);
+    }
+}
+
+void Xdf::ChannelTable::set(const std::string& key, const char* value)
+{
+    auto column = columns.emplace(key, keys.size());
+    if (column.second)
+    {
+        //new key: earlier channels do not have it
+        keys.push_back(key);
+        values.emplace_back(rows);
+        present.emplace_back(rows, false);
+    }
+
+    size_t k = column.first->second;
+    if (rows == 0 || present[k][rows - 1])
+        return;
+    values[k][rows - 1] = value;
+    present[k][rows - 1] = true;
+}
+
+int Xdf::formatSize(const std::string& format)
+{
+    if (format.compare("int8_t") == 0)
+        return 1;
+    if (format.compare("int16_t") == 0)
+        return 2;
+    if (format.compare("float32") == 0 || format.compare("int32_t") == 0)
+        return 4;
+    if (format.compare("double64") == 0 || format.compare("int64_t") == 0)
+        return 8;
+    return 0;
+}
+
+std::string Xdf::footerXml(const Stream& stream)
+{
+    if (!stream.info.nominal_srate || stream.streamFooter.empty())
+        return stream.streamFooter;
+
+    pugi::xml_document doc;
+    doc.load_buffer(stream.streamFooter.data(), stream.streamFooter.size());
+    pugi::xml_node sampleCount = doc.child("info").child("sample_count");
+    pugi::xml_node effectiveSampleRate
+        = doc.child("info").insert_child_after("effective_sample_rate", sampleCount);
+    effectiveSampleRate.append_child(pugi::node_pcdata)
+                       .set_value(std::to_string(stream.info.effective_sample_rate).c_str());
+
+    std::stringstream buffer;
+    doc.save(buffer);
+    return buffer.str();
+}
+
 void Xdf::freeUpTimeStamps()
 {
     //free up as much memory as possible
     for (auto& stream : streams)
     {
-        //we don't need to keep all the time stamps unless it's a stream with irregular samples
-        //filter irregular streams and string streams
+        //irregular streams and string streams keep all their time stamps
         if (stream.info.nominal_srate != 0 && !stream.time_stamps.empty() && stream.info.channel_format.
             compare("string"))
         {
-            std::vector<double> nothing;
-            //however we still need to keep the first time stamp of each stream to decide at which position the signal should start
-            nothing.emplace_back(stream.time_stamps.front());
-            stream.time_stamps.swap(nothing);
+            if (stream.compact_time_stamps.size() != stream.time_stamps.size())
+                stream.compact_time_stamps = CompactTimeStamps::compress(stream.time_stamps, stream.info.nominal_srate);
+
+            //the time stamps are still exactly recoverable from the compact form; keep it when
+            //it is at least four times smaller than the vector
+            const CompactTimeStamps& compact = stream.compact_time_stamps;
+            if (compact.segments.size() * sizeof(TimeStampSegment) +
+                compact.exceptions.size() * sizeof(compact.exceptions[0]) <=
+                stream.time_stamps.size() * sizeof(double) / 4)
+                std::vector<double>().swap(stream.time_stamps);
+            else
+                stream.compact_time_stamps = CompactTimeStamps();
         }
     }
 }
 
+Xdf::CompactTimeStamps Xdf::CompactTimeStamps::compress(const std::vector<double>& ts, double srate)
+{
+    CompactTimeStamps compact;
+    const size_t N = ts.size();
+
+    size_t first = 0;
+    while (first < N)
+    {
+        TimeStampSegment segment;
+        segment.first = first;
+        segment.t0 = ts[first];
+        segment.srate = srate;
+
+        // extend the segment while the time stamps are exactly on its line; a single
+        // time stamp off the line is an exception, two in a row start a new segment
+        size_t k = first + 1;
+        for (; k < N; ++k)
+        {
+            if (ts[k] == segment.t0 + (double)(k - first) / srate)
+                continue;
+            if (k + 1 < N && ts[k + 1] == segment.t0 + (double)(k + 1 - first) / srate)
+            {
+                compact.exceptions.emplace_back(k, ts[k]);
+                continue;
+            }
+            break;
+        }
+
+        segment.count = k - first;
+        compact.segments.emplace_back(segment);
+        first = k;
+    }
+
+    return compact;
+}
+
+double Xdf::CompactTimeStamps::at(size_t k) const
+{
+    if (!exceptions.empty())
+    {
+        auto it = std::lower_bound(exceptions.begin(), exceptions.end(), k,
+                                   [](const std::pair<size_t, double>& e, size_t sample) { return e.first < sample; });
+        if (it != exceptions.end() && it->first == k)
+            return it->second;
+    }
+
+    // last segment starting at or before k
+    auto it = std::upper_bound(segments.begin(), segments.end(), k,
+                               [](size_t sample, const TimeStampSegment& s) { return sample < s.first; });
+    const TimeStampSegment& segment = *(it - 1);
+    return segment.t0 + (double)(k - segment.first) / segment.srate;
+}
+
+void Xdf::CompactTimeStamps::expand(double* out) const
+{
+    for (auto const& segment : segments)
+        for (size_t k = 0; k < segment.count; ++k)
+            out[segment.first + k] = segment.t0 + (double)k / segment.srate;
+
+    for (auto const& exception : exceptions)
+        out[exception.first] = exception.second;
+}
+
+std::vector<double> Xdf::CompactTimeStamps::expand() const
+{
+    std::vector<double> ts(size());
+    expand(ts.data());
+    return ts;
+}
+
 void Xdf::adjustTotalLength()
 {
     for (auto const& stream : streams)
@@ -751,6 +1539,16 @@ void Xdf::adjustTotalLength()
             if (totalLen < stream.time_series.front().size())
                 totalLen = stream.time_series.front().size();
         }
+        else if (!stream.sample_chunks.empty())
+        {
+            if (totalLen < stream.sample_chunks.back().first + stream.sample_chunks.back().count)
+                totalLen = stream.sample_chunks.back().first + stream.sample_chunks.back().count;
+        }
+        else if (stream.info.channel_count > 0)
+        {
+            if (totalLen < stream.string_series.size() / stream.info.channel_count)
+                totalLen = stream.string_series.size() / stream.info.channel_count;
+        }
     }
 }
 
@@ -791,33 +1589,25 @@ void Xdf::calcEffectiveSrate()
     {
         if (stream.info.nominal_srate)
         {
-            try
-            {
+            if (stream.compact_time_stamps.empty())
                 stream.info.effective_sample_rate
                     = stream.info.sample_count /
                     (stream.info.last_timestamp - stream.info.first_timestamp);
-
-                if (stream.info.effective_sample_rate)
-                    effectiveSampleRateVector.emplace_back(stream.info.effective_sample_rate);
-
-                pugi::xml_document doc;
-                doc.load_string(stream.streamFooter.c_str());
-                pugi::xml_node sampleCount = doc.child("info").child("sample_count");
-                pugi::xml_node effectiveSampleRate
-                    = doc.child("info").insert_child_after("effective_sample_rate", sampleCount);
-                effectiveSampleRate.append_child(pugi::node_pcdata)
-                                   .set_value(std::to_string(stream.info.effective_sample_rate).c_str());
-
-                std::stringstream buffer;
-                doc.save(buffer);
-
-                stream.streamFooter = buffer.str();
-            }
-            catch (std::exception& e)
+            else
             {
-                Rcpp::Rcerr << "Error calculating effective sample rate. "
-                    << e.what() << std::endl;
+                // rate fitted by dejitterTimeStamps(), weighted by segment length
+                double samples = 0;
+                double duration = 0;
+                for (auto const& segment : stream.compact_time_stamps.segments)
+                {
+                    samples += segment.count;
+                    duration += segment.count / segment.srate;
+                }
+                stream.info.effective_sample_rate = samples / duration;
             }
+
+            if (stream.info.effective_sample_rate)
+                effectiveSampleRateVector.emplace_back(stream.info.effective_sample_rate);
         }
     }
 }
@@ -902,12 +1692,12 @@ int Xdf::writeEventsToXDF(std::string file_path)
         }
         else
         {
-            Rcpp::Rcerr << "Unable to open file." << std::endl;
+            errors() << "Unable to open file." << std::endl;
             return -1; //Error
         }
     }
 
-    Rcpp::Rcout << "Successfully wrote to XDF file." << std::endl;
+    messages() << "Successfully wrote to XDF file." << std::endl;
 
     return 0; //Success
 }
@@ -918,9 +1708,10 @@ void Xdf::createLabels()
 
     for (size_t st = 0; st < streams.size(); st++)
     {
-        if (streams[st].info.channels.size())
+        const auto& channels = channelInfo(streams[st]);
+        if (channels.size())
         {
-            for (size_t ch = 0; ch < streams[st].info.channels.size(); ch++)
+            for (size_t ch = 0; ch < channels.size(); ch++)
             {
                 // +1 for 1 based numbers; for user convenience only. The internal computation is still 0 based
                 std::string label = "Stream " + std::to_string(st + 1) + " - Channel " + std::to_string(ch + 1)
@@ -928,10 +1719,10 @@ void Xdf::createLabels()
 
                 label += streams[st].info.name + '\n';
 
-                for (auto const& entry : streams[st].info.channels[ch])
+                for (size_t k = 0; k < channels.keys.size(); k++)
                 {
-                    if (entry.second != "")
-                        label += entry.first + " : " + entry.second + '\n';
+                    if (channels.present[k][ch] && channels.values[k][ch] != "")
+                        label += channels.keys[k] + " : " + channels.values[k][ch] + '\n';
                 }
                 if (offsets.size())
                 {
@@ -947,7 +1738,9 @@ void Xdf::createLabels()
         }
         else
         {
-            for (size_t ch = 0; ch < streams[st].time_series.size(); ch++)
+            const size_t channels = streams[st].string_series.empty() && streams[st].sample_chunks.empty() ?
+                streams[st].time_series.size() : streams[st].info.channel_count;
+            for (size_t ch = 0; ch < channels; ch++)
             {
                 // +1 for 1 based numbers; for user convenience only. The internal computation is still 0 based
                 std::string label = "Stream " + std::to_string(st + 1) +
@@ -975,21 +1768,19 @@ void Xdf::createLabels()
 
 void Xdf::loadDictionary()
 {
-    //loop through the eventMap
+    dictionary.clear();
+    eventType.clear();
+    eventType.reserve(eventMap.size());
+
+    //intern the event names; the keys view the strings in eventMap, which outlive the loop
+    std::unordered_map<std::string_view, uint32_t> codes;
     for (auto const& entry : eventMap)
     {
-        //search the dictionary to see whether an event is already in it
-        auto it = std::find(dictionary.begin(), dictionary.end(), entry.first.first);
-        //if it isn't yet
-        if (it == dictionary.end())
-        {
-            //add it to the dictionary, also store its index into eventType vector for future use
-            eventType.emplace_back(dictionary.size());
+        auto inserted = codes.emplace(entry.first.first, (uint32_t)dictionary.size());
+        //first occurrence: add it to the dictionary
+        if (inserted.second)
             dictionary.emplace_back(entry.first.first);
-        }
-        //if it's already in there
-        else //store its index into eventType vector
-            eventType.emplace_back(std::distance(dictionary.begin(), it));
+        eventType.emplace_back(inserted.first->second);
     }
 }
 
@@ -26,8 +26,13 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <cstdint>
 #include <variant>
+#include <string_view>
+#include <ostream>
+
+#include "smarc.h"      //SMARC_DESIGN_* filter designs
 
 /*! \class Xdf
  *
@@ -42,6 +47,152 @@ public:
     //! Default constructor with no parameter.
     Xdf();
 
+    /*!
+     * \brief A run of regularly sampled time stamps.
+     *
+     * Sample `first + k` of the stream, for `k < count`, is at time
+     * `t0 + k / srate`.
+     */
+    struct TimeStampSegment
+    {
+        size_t first;   /*!< Index of the first sample of the segment. */
+        size_t count;   /*!< Number of samples in the segment. */
+        double t0;      /*!< Time stamp of the first sample. */
+        double srate;   /*!< Sample rate fitted over the segment. */
+    };
+
+    /*!
+     * \brief Time stamps stored as regular segments plus the samples that
+     * do not fall exactly on them.
+     *
+     * Memory is O(segments + exceptions) instead of one double per sample,
+     * and every time stamp is recovered exactly by at() or expand().
+     */
+    class CompactTimeStamps
+    {
+    public:
+        std::vector<TimeStampSegment> segments;    /*!< Consecutive segments covering every sample. */
+        std::vector<std::pair<size_t, double>> exceptions; /*!< Sorted (sample, time stamp) pairs off their segment line. */
+
+        /*!
+         * \brief Build the exact compact form of `ts`.
+         *
+         * Segments run at the nominal rate from their first time stamp. A single
+         * time stamp off the line is kept as an exception; two in a row start a
+         * new segment, so explicit chunk time stamps that are followed by deduced
+         * ones each start a segment.
+         * \param srate is the nominal sample rate of the stream.
+         */
+        static CompactTimeStamps compress(const std::vector<double>& ts, double srate);
+
+        bool empty() const { return segments.empty(); }
+        size_t size() const { return segments.empty() ? 0 : segments.back().first + segments.back().count; }
+
+        /*!
+         * \brief Time stamp of sample k, found by binary search over the segments.
+         */
+        double at(size_t k) const;
+
+        /*!
+         * \brief Write all `size()` time stamps to `out`.
+         */
+        void expand(double* out) const;
+        std::vector<double> expand() const;
+    };
+
+    /*!
+     * \brief Values of a string stream: all the bytes in one buffer plus the
+     * offset of each value.
+     *
+     * Values are stored sample by sample, so value `m * channel_count + v` is
+     * sample m of channel v.
+     */
+    class StringArena
+    {
+    public:
+        std::vector<char> bytes;            /*!< All values back to back, without terminators. */
+        std::vector<size_t> offsets{ 0 };   /*!< Value i is `bytes[offsets[i], offsets[i + 1])`. */
+
+        bool empty() const { return offsets.size() == 1; }
+        size_t size() const { return offsets.size() - 1; }
+        const char* data(size_t i) const { return bytes.data() + offsets[i]; }
+        size_t length(size_t i) const { return offsets[i + 1] - offsets[i]; }
+        std::string_view at(size_t i) const { return std::string_view(data(i), length(i)); }
+
+        /*!
+         * \brief Add a value of `length` bytes and return where to write them.
+         */
+        char* append(size_t length)
+        {
+            const size_t first = bytes.size();
+            bytes.resize(first + length);
+            offsets.push_back(first + length);
+            return bytes.data() + first;
+        }
+    };
+
+    /*!
+     * \brief Meta-data of the channels of a stream, stored by column.
+     *
+     * Every key met in any channel gets one column, in order of first
+     * appearance, with one value per channel.
+     */
+    class ChannelTable
+    {
+    public:
+        std::vector<std::string> keys;                  /*!< Column names. */
+        std::vector<std::vector<std::string>> values;   /*!< One column per key, one value per channel. */
+        std::vector<std::vector<bool>> present;         /*!< Whether the channel has the key at all. */
+
+        bool empty() const { return rows == 0; }
+        size_t size() const { return rows; }
+        void clear();
+
+        /*!
+         * \brief Add a channel with no values.
+         */
+        void addRow();
+
+        /*!
+         * \brief Set `key` of the last channel, unless it is set already.
+         */
+        void set(const std::string& key, const char* value);
+
+    private:
+        size_t rows = 0;
+        std::unordered_map<std::string, size_t> columns; //column of each key
+    };
+
+    /*!
+     * \brief Where a chunk of samples of a stream is in the file, see LoadOptions::lazyValues.
+     */
+    struct SampleChunk
+    {
+        uint64_t offset;    /*!< File offset of the first sample of the chunk. */
+        uint64_t first;     /*!< Index of the first sample of the chunk in the stream. */
+        uint64_t count;     /*!< Number of samples in the chunk. */
+    };
+
+    /*!
+     * \brief How timeToIndex() maps a time to a sample.
+     */
+    enum class IndexMethod
+    {
+        Nearest,    /*!< Sample closest in time; the earlier one on ties. */
+        Floor,      /*!< Last sample at or before the time. */
+        Ceil        /*!< First sample at or after the time. */
+    };
+
+    /*!
+     * \brief An event of a string stream: one value of `string_series`.
+     */
+    struct Event
+    {
+        double timestamp;   /*!< Synced time stamp of the event. */
+        size_t sample;      /*!< Sample index in the stream. */
+        int channel;        /*!< Channel index in the stream. */
+    };
+
     //subclass for single streams
     /*! \class Stream
      *
@@ -55,10 +206,12 @@ public:
     struct Stream
     {
         //! A 2D vector which stores the time series of a stream. Each row represents a channel.
+        //! Empty for string streams, whose values are in `string_series`.
         std::vector<std::vector<std::variant<int, float, double, int64_t, std::string>>> time_series;
+        StringArena string_series; /*!< Values of a string stream. */
         std::vector<double> time_stamps; /*!< A vector to store time stamps. */
         std::string streamHeader;   /*!< Raw XML of stream header chunk. */
-        std::string streamFooter;   /*!< Raw XML of stream footer chunk. */
+        std::string streamFooter;   /*!< Raw XML of stream footer chunk, see footerXml(). */
 
         struct
         {
@@ -68,7 +221,9 @@ public:
             std::string type;       /*!< Type of the current stream. */
             std::string channel_format;/*!< Channel format of the current stream. */
 
-            std::vector<std::map<std::string, std::string> > channels;/*!< A vector to store the meta-data of the channels of the current stream. */
+            ChannelTable channels;  /*!< Meta-data of the channels of the current stream.
+                                     * Filled on first use, read it through channelInfo(). */
+            bool channels_parsed = false;   /*!< Whether `channels` has been parsed from the stream header. */
 
             std::vector<std::pair<double, double> > clock_offsets;  /*!< A vector to store clock offsets from the ClockOffset chunk. */
 
@@ -83,6 +238,56 @@ public:
         double sampling_interval;    /*!< If srate > 0, sampling_interval = 1/srate; otherwise 0 */
         std::vector<double> clock_times;/*!< Vector of clock times from clock offset chunk (Tag 4). */
         std::vector<double> clock_values;/*!< Vector of clock values from clock offset chunk (Tag 4). */
+        std::vector<Event> events;  /*!< Events of a string stream sorted by time, see buildEventIndex(). */
+        CompactTimeStamps compact_time_stamps;/*!< Compact form of `time_stamps`, built by dejitterTimeStamps(),
+                                               * resample() or freeUpTimeStamps(). */
+        std::vector<SampleChunk> sample_chunks;/*!< Chunks of a numeric stream whose values were left in the
+                                                * file, see LoadOptions::lazyValues. */
+    };
+
+    /*!
+     * \brief Quality presets for resample().
+     *
+     * - Draft: 60 dB stopband, 80% bandwidth, Kaiser design. Meant for quick looks,
+     *   roughly an order of magnitude cheaper than Archival.
+     * - Standard: 100 dB stopband, 90% bandwidth, Remez design.
+     * - Archival: 140 dB stopband, 95% bandwidth, Remez design.
+     */
+    enum class ResampleQuality { Draft, Standard, Archival };
+
+    /*!
+     * \brief Parameters of the smarc filter built by resample().
+     *
+     * Default values are the Archival preset. See smarc_init_pfilter()
+     * for the meaning of each field.
+     */
+    struct ResampleOptions
+    {
+        double bandwidth = 0.95;    /*!< Fraction of the maximum possible bandwidth to keep. */
+        double rp = 0.1;            /*!< Passband ripple in dB. */
+        double rs = 140;            /*!< Stopband attenuation in dB. */
+        double tol = 0.000001;      /*!< Sample rate conversion error tolerance. */
+        int design = SMARC_DESIGN_REMEZ; /*!< SMARC_DESIGN_REMEZ or SMARC_DESIGN_KAISER. */
+
+        /*!
+         * \brief Return the filter parameters of a quality preset.
+         */
+        static ResampleOptions preset(ResampleQuality quality);
+    };
+
+    /*!
+     * \brief Options of load_xdf().
+     */
+    struct LoadOptions
+    {
+        int userSrate = 0;              /*!< Resample numeric streams to this rate while loading; 0 keeps the original rates. */
+        ResampleOptions resample;       /*!< Filter parameters used when userSrate is set. */
+        bool dejitter = true;           /*!< Refit the time stamps of regular streams, see dejitterTimeStamps(). */
+        double breakThresholdSeconds = 1;   /*!< Gaps longer than this many seconds start a new segment... */
+        double breakThresholdSamples = 500; /*!< ...if they also exceed this many nominal sample intervals. */
+        bool lazyValues = false;        /*!< Leave the values of numeric streams in the file and only index their
+                                         * chunks in Stream::sample_chunks, to be read with decodeChunk().
+                                         * `time_series` stays empty and userSrate is ignored. */
     };
 
     //XDF properties=================================================================================
@@ -119,7 +324,7 @@ public:
     std::vector<std::pair<std::pair<eventName, eventTimeStamp>, int> > eventMap;/*!< The vector to store all the events across all streams.
                                                                                  * The format is <<events, timestamps>, streamNum>. */
     std::vector<std::string> dictionary;/*!< The vector to store unique event types with no repetitions. \sa eventMap */
-    std::vector<uint16_t> eventType;    /*!< The vector to store events by their index in the dictionary.\sa dictionary, eventMap */
+    std::vector<uint32_t> eventType;    /*!< The vector to store events by their index in the dictionary.\sa dictionary, eventMap */
     std::vector<std::string> labels;    /*!< The vector to store descriptive labels of each channel. */
     std::set<double> sampleRateMap;  /*!< The vector to store all sample rates across all the streams. */
     std::vector<float> offsets;         /*!< Offsets of each channel after using subtractMean() function */
@@ -130,6 +335,10 @@ public:
                                           * The index will be userAddedStream.  */
     std::vector<std::pair<std::string, double> > userCreatedEvents;/*!< User created events in Sigviewer. */
 
+    std::ostream* logStream = nullptr;  /*!< Where messages are written. nullptr writes them to the R console,
+                                         * which is only allowed on the R main thread; loaders running on
+                                         * other threads set it to a buffer of their own. */
+
     //Public Functions==============================================================================================
 
     /*!
@@ -157,12 +366,52 @@ public:
      */
     void calcTotalLength(int sampleRate);
 
+    /*!
+     * \brief Index the events of every string stream and rebuild `eventMap`.
+     *
+     * Each string stream gets its values sorted by time in `Stream::events`,
+     * and its first and last time stamps are taken from them. `eventMap` is
+     * then a k-way merge of these sorted lists, which costs
+     * O(events log streams). Call after syncTimeStamps().
+     */
+    void buildEventIndex();
+
+    /*!
+     * \brief Meta-data of the channels of a stream.
+     *
+     * load_xdf() only parses the fields of the stream header needed to decode
+     * the samples. The `<desc>` tree, which can be large for montages with
+     * many channels, is parsed into `info.channels` on the first call.
+     */
+    static const ChannelTable& channelInfo(Stream& stream);
+
     /*!
      * \brief Create labels for each channel and store them in _labels_ vector.
      * \sa labels, offsets
      */
     void createLabels();
 
+    /*!
+     * \brief Decode one channel of a chunk of samples mapped from the file.
+     *
+     * \param chunk points to the first sample of the chunk, at SampleChunk::offset.
+     * \param out receives `count` values.
+     */
+    static void decodeChunk(const char* chunk, uint64_t count, int channelCount, const std::string& format,
+                            int channel, double* out);
+
+    /*!
+     * \brief Remove the jitter from the time stamps of regular streams.
+     *
+     * Each stream with a nominal sample rate is split into segments wherever
+     * consecutive time stamps jump, forwards or backwards, by more than both
+     * thresholds. A straight line is fitted to each segment by least squares
+     * in a single pass, and the time stamps are rewritten on that line. The
+     * segments are kept in `Stream::compact_time_stamps`. Streams are processed
+     * in parallel.
+     */
+    void dejitterTimeStamps(double breakThresholdSeconds = 1, double breakThresholdSamples = 500);
+
     /*!
      * \brief Subtract the entire channel by its mean.
      *
@@ -177,15 +426,36 @@ public:
      */
     void detrend();
 
+    /*!
+     * \brief Set the stream header of `stream` and the fields decoding needs.
+     *
+     * Only channel_count, nominal_srate, name, type and channel_format are
+     * parsed; the channel metadata waits for channelInfo().
+     */
+    static void parseStreamHeader(Stream& stream, std::string header);
+
+    /*!
+     * \brief Size in bytes of a value of a numeric channel format; 0 for string
+     * and unknown formats.
+     */
+    static int formatSize(const std::string& format);
+
+    /*!
+     * \brief Footer XML of a stream with its `effective_sample_rate`.
+     *
+     * The raw footer is kept as read. The effective sample rate is inserted
+     * after `sample_count` only here, when the XML is asked for.
+     */
+    static std::string footerXml(const Stream& stream);
+
     /*!
      * \brief Delete the time stamps vectors when no longer needed to
      * release some memory.
      *
-     * Sigviewer doesn't demand time stamps to display signals except
-     * irregular sample rate channels, events, and the first time stamp
-     * of each channel (used to decide where does a channel start when
-     * putting all streams together). In this case we can delete the time
-     * stamps when no longer needed to free up some memory.
+     * Regular numeric streams keep their time stamps in `compact_time_stamps`
+     * only, so they stay exactly recoverable. Streams whose time stamps are
+     * too irregular for the compact form to be at least four times smaller,
+     * irregular-rate streams and string streams keep the full vector.
      */
     void freeUpTimeStamps();
 
@@ -196,15 +466,62 @@ public:
      */
     int load_xdf(std::string filename);
 
+    /*!
+     * \brief Load an XDF file with the given options.
+     *
+     * When `options.userSrate` is set, each decoded [Samples] chunk of a stream
+     * whose nominal sample rate differs goes straight through a per-channel
+     * smarc state, so only the resampled samples are ever stored. The samples
+     * are the same as with load_xdf() followed by resample().
+     */
+    int load_xdf(std::string filename, const LoadOptions& options);
+
+    /*!
+     * \brief Find the sample indices of a batch of times.
+     *
+     * `timeStamps` must be in increasing order. Each lookup is a binary search;
+     * when `times` is sorted too, each search starts from the previous result.
+     * \param out receives `count` 0-based indices, -1 where there is no such
+     * sample (Floor before the first sample, Ceil after the last).
+     */
+    static void timeToIndex(const double* timeStamps, size_t n, const double* times, size_t count,
+                            IndexMethod method, int64_t* out);
+
+    /*!
+     * \brief Find the sample indices of a batch of times in a stream.
+     *
+     * Uses `time_stamps` when they are loaded. Otherwise the compact time stamps
+     * are searched, and without exceptions each lookup costs a binary search
+     * over the segments plus O(1) arithmetic inside one.
+     */
+    static void timeToIndex(const Stream& stream, const double* times, size_t count, IndexMethod method,
+                            int64_t* out);
+    static int64_t timeToIndex(const Stream& stream, double time, IndexMethod method);
+
     /*!
      * \brief Resample all streams and channel to a chosen sample rate
      * \param userSrate is recommended to be between integer 1 and
      * the highest sample rate of the current file.
+     * \param options are the filter parameters, usually taken from
+     * ResampleOptions::preset(). The overload without options uses the
+     * Archival preset.
+     *
+     * Every resampled stream gets new channel rows of the resampled length and
+     * a uniform `time_stamps` vector starting at its first time stamp, and its
+     * `nominal_srate`, `sampling_interval` and first/last time stamps are updated.
      */
+    void resample(int userSrate, const ResampleOptions& options);
     void resample(int userSrate);
 
     /*!
-     * \brief syncTimeStamps
+     * \brief Correct all time stamps with the ClockOffset measurements of
+     * their stream.
+     *
+     * The offset is interpolated linearly between consecutive measurements
+     * and held constant before the first and after the last one. Clock resets
+     * are detected and corrected separately, see findClockResets(). Events
+     * of string streams are indexed from the synced time stamps afterwards
+     * by buildEventIndex().
      */
     void syncTimeStamps();
 
@@ -221,7 +538,14 @@ public:
 private:
 
     /*!
-     * \brief calcEffectiveSrate
+     * \brief The stream messages and errors are written to, see `logStream`.
+     */
+    std::ostream& messages();
+    std::ostream& errors();
+
+    /*!
+     * \brief Calculate the effective sample rate of each regular stream
+     * into `info.effective_sample_rate` and `effectiveSampleRateVector`.
      */
     void calcEffectiveSrate();
 
@@ -237,6 +561,21 @@ private:
      */
     void calcTotalChannel();
 
+    /*!
+     * \brief Segment and refit the time stamps of a single stream, see dejitterTimeStamps().
+     */
+    static void dejitterStream(Stream& stream, double breakThresholdSeconds, double breakThresholdSamples);
+
+    /*!
+     * \brief Split the ClockOffset measurements of a stream at clock resets.
+     *
+     * A reset is a place where both the interval between measurements and the
+     * change of offset jump far from their medians, as measured in median absolute
+     * deviations and in seconds (as in pyxdf). Runs in linear time.
+     * \return The `[begin, end)` index ranges of `clock_times` between resets.
+     */
+    static std::vector<std::pair<size_t, size_t>> findClockResets(const Stream& stream);
+
     /*!
      * \brief Find the sample rate that has the most channels.
      *
@@ -275,9 +614,15 @@ private:
      */
     void getHighestSampleRate();
 
+    /*!
+     * \brief Fill `Stream::events` of a string stream, see buildEventIndex().
+     */
+    static void indexStreamEvents(Stream& stream);
+
     /*!
      * \brief Copy all unique types of events from _eventMap_ to
-     * _dictionary_ with no repeats.
+     * _dictionary_ with no repeats, in order of first appearance, and
+     * store the dictionary index of each event in _eventType_.
      * \sa dictionary, eventMap
      */
     void loadDictionary();
@@ -289,6 +634,26 @@ private:
      */
     void loadSampleRateMap();
 
+    /*!
+     * \brief Give a resampled stream uniform time stamps and update its rate.
+     *
+     * `time_stamps` becomes `t0 + k / srate` for `length` samples, and
+     * `nominal_srate`, `sampling_interval`, `sample_count` and the first/last
+     * time stamps are set to match.
+     */
+    void setUniformTimeStamps(Stream& stream, double t0, int srate, size_t length);
+
+    /*!
+     * \brief Add the interpolated clock offset to every time stamp of a stream.
+     *
+     * Time stamps are walked once along with the clock times, so a stream costs
+     * one pass over its samples plus one over its ClockOffset chunks. When the
+     * offsets are split by clock resets, the samples are split where their time
+     * jumps backwards and each run is corrected with its own offset range.
+     * \param ranges are the offset ranges found by findClockResets().
+     */
+    static void syncStreamTimeStamps(Stream& stream, const std::vector<std::pair<size_t, size_t>>& ranges);
+
     /*!
      * \brief This function will get the length of the upcoming chunk, or the number of samples.
      *
@@ -0,0 +1,234 @@
+/*
+ *  \file xdf_handle.cpp
+ * An XDF file kept loaded in memory, shared with R through an external pointer
+ */
+
+#include <Rcpp.h>
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "xdf.h"
+#include "rxdf.h"
+
+using namespace Rcpp;
+
+// The Xdf behind a handle returned by xdf_open()
+static Xdf& handle_xdf(SEXP handle) {
+  if(TYPEOF(handle) != EXTPTRSXP || !Rf_inherits(handle, "xdf_handle")) {
+    Rcpp::stop("expected a handle returned by xdf_open()");
+  }
+  Xdf* xdf = static_cast<Xdf*>(R_ExternalPtrAddr(handle));
+  if(!xdf) {
+    // external pointers are not saved with the session
+    Rcpp::stop("the xdf handle is no longer valid, open the file again");
+  }
+  return *xdf;
+}
+
+static Xdf::Stream& handle_stream(SEXP handle, int stream_id) {
+  Xdf& xdf = handle_xdf(handle);
+  if(stream_id < 1 || stream_id > (int)xdf.streams.size()) {
+    Rcpp::stop("stream_id must be between 1 and %d", (int)xdf.streams.size());
+  }
+  return xdf.streams[stream_id - 1];
+}
+
+static size_t sample_count(const Xdf::Stream& stream) {
+  if(!stream.string_series.empty()) {
+    return stream.string_series.size() / std::max(stream.info.channel_count, 1);
+  }
+  return stream.time_series.empty() ? 0 : stream.time_series[0].size();
+}
+
+// [[Rcpp::export]]
+SEXP xdf_open(Rcpp::String filename_, Rcpp::Nullable<Rcpp::NumericVector> target_rate = R_NilValue,
+              std::string quality = "standard", Rcpp::Nullable<Rcpp::List> resample_options = R_NilValue,
+              bool dejitter = true) {
+  Rcpp::XPtr<Xdf> handle(new Xdf, true);
+  Xdf::LoadOptions load_options = get_load_options(target_rate, quality, resample_options, dejitter);
+  if(handle->load_xdf(filename_.get_cstring(), load_options) != 0) {
+    Rcpp::stop("could not load '%s'", filename_.get_cstring());
+  }
+  handle->freeUpTimeStamps();
+
+  handle.attr("class") = "xdf_handle";
+  return handle;
+}
+
+// [[Rcpp::export]]
+DataFrame xdf_streams(SEXP handle) {
+  Xdf& xdf = handle_xdf(handle);
+  const size_t n = xdf.streams.size();
+
+  IntegerVector stream_id(n);
+  CharacterVector name(n), type(n), channel_format(n);
+  IntegerVector channel_count(n);
+  NumericVector nominal_srate(n), effective_sample_rate(n), samples(n);
+  for(size_t i = 0; i < n; ++i) {
+    const Xdf::Stream& stream = xdf.streams[i];
+    stream_id[i] = (int)i + 1;
+    name[i] = stream.info.name;
+    type[i] = stream.info.type;
+    channel_format[i] = stream.info.channel_format;
+    channel_count[i] = stream.info.channel_count;
+    nominal_srate[i] = stream.info.nominal_srate;
+    effective_sample_rate[i] = stream.info.effective_sample_rate;
+    samples[i] = (double)sample_count(stream);
+  }
+
+  return DataFrame::create(
+    Named("stream_id") = stream_id,
+    Named("name") = name,
+    Named("type") = type,
+    Named("channel_count") = channel_count,
+    Named("channel_format") = channel_format,
+    Named("nominal_srate") = nominal_srate,
+    Named("effective_sample_rate") = effective_sample_rate,
+    Named("sample_count") = samples,
+    Named("stringsAsFactors") = false
+  );
+}
+
+// [[Rcpp::export]]
+List xdf_stream(SEXP handle, int stream_id) {
+  Xdf::Stream& stream = handle_stream(handle, stream_id);
+  return get_stream(stream, get_timeseries(stream), get_time_stamps(stream));
+}
+
+// [[Rcpp::export]]
+List xdf_window(SEXP handle, int stream_id, double tmin, double tmax) {
+  Xdf::Stream& stream = handle_stream(handle, stream_id);
+
+  // only the samples from tmin to tmax are converted
+  int64_t first = Xdf::timeToIndex(stream, tmin, Xdf::IndexMethod::Ceil);
+  int64_t last = Xdf::timeToIndex(stream, tmax, Xdf::IndexMethod::Floor);
+  size_t count = 0;
+  if(first >= 0 && last >= first) {
+    count = (size_t)(last - first + 1);
+  } else {
+    first = 0;
+  }
+
+  return get_stream(stream, get_timeseries(stream, first, count), get_time_stamps(stream, first, count));
+}
+
+// [[Rcpp::export]]
+IntegerVector xdf_time_to_index(SEXP handle, int stream_id, NumericVector times, std::string method = "nearest") {
+  Xdf::Stream& stream = handle_stream(handle, stream_id);
+  std::vector<int64_t> found(times.size());
+  Xdf::timeToIndex(stream, times.begin(), times.size(), get_index_method(method), found.data());
+  return get_indices(found);
+}
+
+// [[Rcpp::export]]
+SEXP xdf_resample(SEXP handle, int target_rate, std::string quality = "standard",
+                  Rcpp::Nullable<Rcpp::List> resample_options = R_NilValue) {
+  Xdf& xdf = handle_xdf(handle);
+  // the streams are resampled in place, from the samples already in memory
+  xdf.resample(target_rate, get_resample_options(quality, resample_options));
+  xdf.freeUpTimeStamps();
+  return handle;
+}
+
+// [[Rcpp::export]]
+NumericVector xdf_epoch(SEXP handle, int stream_id, NumericVector events, double tmin, double tmax,
+                        Rcpp::Nullable<Rcpp::NumericVector> baseline = R_NilValue) {
+  Xdf::Stream& stream = handle_stream(handle, stream_id);
+  if(stream.info.nominal_srate <= 0) {
+    Rcpp::stop("epochs need a stream with a regular sample rate");
+  }
+  if(!stream.string_series.empty() || stream.time_series.empty()) {
+    Rcpp::stop("epochs need a numeric stream");
+  }
+
+  std::vector<double> expanded;
+  const double* time_stamps = stream.time_stamps.data();
+  size_t n_samples = stream.time_stamps.size();
+  if(stream.time_stamps.empty()) {
+    expanded = stream.compact_time_stamps.expand();
+    time_stamps = expanded.data();
+    n_samples = expanded.size();
+  }
+  EpochWindows windows = sample_windows(time_stamps, n_samples, stream.info.nominal_srate, events, tmin, tmax,
+                                        baseline);
+
+  // only the samples under a window are converted to double: overlapping
+  // windows are merged into runs [first, last) of the stream, packed one
+  // after the other from `packed` on
+  struct Run {
+    int64_t first, last, packed;
+  };
+  std::vector<int64_t> starts;
+  for(int64_t start : windows.starts) {
+    if(start >= 0) starts.push_back(start);
+  }
+  std::sort(starts.begin(), starts.end());
+  std::vector<Run> runs;
+  auto packed_end = [&runs] { return runs.empty() ? 0 : runs.back().packed + runs.back().last - runs.back().first; };
+  for(int64_t start : starts) {
+    const int64_t end = start + (int64_t)windows.length;
+    if(!runs.empty() && start <= runs.back().last) {
+      runs.back().last = std::max(runs.back().last, end);
+    } else {
+      runs.push_back({ start, end, packed_end() });
+    }
+  }
+  const int64_t n_packed = packed_end();
+  for(int64_t& start : windows.starts) {
+    if(start < 0) continue;
+    auto run = std::upper_bound(runs.begin(), runs.end(), start,
+                                [](int64_t sample, const Run& r) { return sample < r.first; }) - 1;
+    start = run->packed + (start - run->first);
+  }
+
+  const int n_channels = (int)stream.time_series.size();
+  std::vector<std::vector<double>> columns(n_channels);
+#pragma omp parallel for
+  for(int v = 0; v < n_channels; ++v) {
+    const auto& row = stream.time_series[v];
+    columns[v].resize(n_packed);
+    double* out = columns[v].data();
+    for(const Run& run : runs) {
+      for(int64_t k = run.first; k < run.last; ++k) {
+        *out++ = std::visit([](auto&& value) -> double {
+          using T = std::decay_t<decltype(value)>;
+          if constexpr (std::is_arithmetic_v<T>) {
+            return static_cast<double>(value);
+          } else {
+            return NA_REAL;
+          }
+        }, row[k]);
+      }
+    }
+  }
+
+  std::vector<const double*> channels;
+  for(auto& column : columns) {
+    channels.push_back(column.data());
+  }
+
+  CharacterVector channel_names = get_column_names(get_channels(Xdf::channelInfo(stream)), n_channels);
+  return epoch_array(channels, channel_names, windows, tmin, stream.info.nominal_srate);
+}
+
+// [[Rcpp::export]]
+DataFrame xdf_json_fields(SEXP handle, int stream_id, CharacterVector fields, int channel = 1) {
+  Xdf::Stream& stream = handle_stream(handle, stream_id);
+  if(stream.string_series.empty() && !stream.time_series.empty()) {
+    Rcpp::stop("JSON fields need a string stream");
+  }
+  const int n_channels = std::max(stream.info.channel_count, 1);
+  if(channel < 1 || channel > n_channels) {
+    Rcpp::stop("channel must be between 1 and %d", n_channels);
+  }
+
+  // the payloads are scanned where they lie in the arena, without making R strings of them
+  const size_t n = stream.string_series.size() / n_channels;
+  std::vector<std::string_view> payloads(n);
+  for(size_t m = 0; m < n; ++m) {
+    payloads[m] = stream.string_series.at(m * n_channels + channel - 1);
+  }
+  return json_table(payloads, fields);
+}
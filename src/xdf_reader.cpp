@@ -0,0 +1,494 @@
+/*
+ *  \file xdf_reader.cpp
+ * Rcpp module reading an XDF file block by block in bounded memory
+ */
+
+#include <Rcpp.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "xdf.h"
+#include "rxdf.h"
+
+namespace
+{
+    template <typename T>
+    T readBin(std::istream& is)
+    {
+        T value{};
+        is.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+
+    //variable-length integer of the file, 0 at the end of the file
+    uint64_t readLength(std::istream& is)
+    {
+        uint8_t bytes = readBin<uint8_t>(is);
+        if (!is)
+            return 0;
+        switch (bytes)
+        {
+        case 1:
+            return readBin<uint8_t>(is);
+        case 4:
+            return readBin<uint32_t>(is);
+        case 8:
+            return readBin<uint64_t>(is);
+        default:
+            return 0;
+        }
+    }
+
+    //the same, from a chunk in memory; false if it does not fit
+    bool readLength(const char*& p, const char* end, uint64_t& length)
+    {
+        if (p >= end)
+            return false;
+        uint8_t bytes = static_cast<uint8_t>(*p++);
+        if ((bytes != 1 && bytes != 4 && bytes != 8) || p + bytes > end)
+            return false;
+        if (bytes == 1)
+            length = static_cast<uint8_t>(*p);
+        else if (bytes == 4)
+        {
+            uint32_t value;
+            std::memcpy(&value, p, 4);
+            length = value;
+        }
+        else
+            std::memcpy(&length, p, 8);
+        p += bytes;
+        return true;
+    }
+
+    template <typename T>
+    void appendValues(const char* p, std::vector<std::vector<double>>& values)
+    {
+        for (auto& channel : values)
+        {
+            T value;
+            std::memcpy(&value, p, sizeof(T));
+            channel.push_back(static_cast<double>(value));
+            p += sizeof(T);
+        }
+    }
+}
+
+/*!
+ * \brief Reads the samples of selected streams in blocks, in file order.
+ *
+ * The constructor scans the chunk headers once for the stream headers and
+ * the clock offsets, which are small. readNext() then decodes samples chunks
+ * only until a block is full, into buffers that are reused, so memory stays
+ * bounded whatever the length of the recording. Time stamps are synced by
+ * piecewise linear interpolation of the clock offsets, as in load_xdf(), but
+ * are neither dejittered nor checked for clock resets.
+ */
+class XdfReader
+{
+public:
+    explicit XdfReader(std::string filename) : filename(filename)
+    {
+        scan();
+        for (auto& stream : streams)
+            stream.selected = true;
+    }
+
+    XdfReader(std::string filename, Rcpp::IntegerVector streamIds) : filename(filename)
+    {
+        scan();
+        for (int id : streamIds)
+        {
+            if (id < 1 || id > (int)streams.size())
+                Rcpp::stop("there is no stream %d in '%s'", id, filename);
+            streams[id - 1].selected = true;
+        }
+    }
+
+    /*!
+     * \brief Next block of every selected stream, at most `n` samples each.
+     *
+     * Chunks are read until one of the streams has `n` samples buffered, so the
+     * block ends at the same point in the file for all of them.
+     */
+    Rcpp::List readNext(int n)
+    {
+        if (n <= 0)
+            Rcpp::stop("n must be positive");
+
+        auto full = [&]() {
+            for (auto const& stream : streams)
+                if (stream.selected && stream.time_stamps.size() >= (size_t)n)
+                    return true;
+            return false;
+        };
+        while (!full() && readChunk())
+            ;
+
+        Rcpp::List blocks;
+        Rcpp::CharacterVector names;
+        for (auto& stream : streams)
+        {
+            if (!stream.selected)
+                continue;
+            blocks.push_back(emit(stream, n));
+            names.push_back(stream.stream.info.name);
+        }
+        blocks.names() = names;
+        return blocks;
+    }
+
+    /*!
+     * \brief Go back to the first sample.
+     */
+    void reset()
+    {
+        file.clear();
+        file.seekg(dataStart);
+        atEnd = false;
+        for (auto& stream : streams)
+        {
+            stream.time_stamps.clear();
+            for (auto& channel : stream.values)
+                channel.clear();
+            for (auto& channel : stream.strings)
+                channel.clear();
+            stream.anchor = 0;
+            stream.deduced = 0;
+            stream.last_timestamp = 0;
+            stream.offset = 0;
+        }
+    }
+
+    bool done() const
+    {
+        if (!atEnd)
+            return false;
+        for (auto const& stream : streams)
+            if (stream.selected && !stream.time_stamps.empty())
+                return false;
+        return true;
+    }
+
+    Rcpp::DataFrame streamTable()
+    {
+        Rcpp::IntegerVector position, id, channel_count;
+        Rcpp::CharacterVector name, type, channel_format;
+        Rcpp::NumericVector nominal_srate;
+        Rcpp::LogicalVector selected;
+        for (size_t k = 0; k < streams.size(); k++)
+        {
+            const Xdf::Stream& stream = streams[k].stream;
+            position.push_back(k + 1);
+            id.push_back(streams[k].id);
+            name.push_back(stream.info.name);
+            type.push_back(stream.info.type);
+            channel_count.push_back(stream.info.channel_count);
+            nominal_srate.push_back(stream.info.nominal_srate);
+            channel_format.push_back(stream.info.channel_format);
+            selected.push_back(streams[k].selected);
+        }
+        return Rcpp::DataFrame::create(
+            Rcpp::Named("stream") = position,
+            Rcpp::Named("id") = id,
+            Rcpp::Named("name") = name,
+            Rcpp::Named("type") = type,
+            Rcpp::Named("channel_count") = channel_count,
+            Rcpp::Named("nominal_srate") = nominal_srate,
+            Rcpp::Named("channel_format") = channel_format,
+            Rcpp::Named("selected") = selected
+        );
+    }
+
+private:
+    struct ReaderStream
+    {
+        Xdf::Stream stream;         //header fields and clock offsets
+        uint32_t id = 0;
+        bool selected = false;
+
+        //samples decoded but not returned yet
+        std::vector<double> time_stamps;
+        std::vector<std::vector<double>> values;        //numeric streams, per channel
+        std::vector<std::vector<std::string>> strings;  //string streams, per channel
+        std::vector<std::string> names;                 //column names, set on first use
+
+        double anchor = 0;          //last explicit time stamp
+        uint64_t deduced = 0;       //samples since
+        double last_timestamp = 0;
+        size_t offset = 0;          //clock offset interval of the last time stamp
+    };
+
+    size_t streamIndex(uint32_t id)
+    {
+        auto it = indices.find(id);
+        if (it != indices.end())
+            return it->second;
+        indices.emplace(id, streams.size());
+        streams.emplace_back();
+        streams.back().id = id;
+        return streams.size() - 1;
+    }
+
+    //first pass: stream headers and clock offsets; streams are numbered in order of appearance, as in load_xdf()
+    void scan()
+    {
+        file.open(filename, std::ios::in | std::ios::binary);
+        char magic[4] = {};
+        file.read(magic, 4);
+        if (!file || std::memcmp(magic, "XDF:", 4))
+            Rcpp::stop("'%s' is not a valid XDF file", filename);
+        dataStart = file.tellg();
+
+        for (uint64_t length; (length = readLength(file)) >= 2;)
+        {
+            uint16_t tag = readBin<uint16_t>(file);
+            std::streampos next = file.tellg() + (std::streamoff)(length - 2);
+            if (tag >= 2 && tag <= 6 && tag != 5 && length >= 6)
+            {
+                size_t k = streamIndex(readBin<uint32_t>(file));
+                if (tag == 2)
+                {
+                    std::string header(length - 6, '\0');
+                    file.read(&header[0], length - 6);
+                    Xdf::parseStreamHeader(streams[k].stream, std::move(header));
+                }
+                else if (tag == 4)
+                {
+                    streams[k].stream.clock_times.push_back(readBin<double>(file));
+                    streams[k].stream.clock_values.push_back(readBin<double>(file));
+                }
+            }
+            if (!file)
+                break;
+            file.seekg(next);
+        }
+
+        for (auto& stream : streams)
+        {
+            int channels = stream.stream.info.channel_count;
+            if (stream.stream.info.channel_format.compare("string") == 0)
+                stream.strings.resize(channels);
+            else
+                stream.values.resize(channels);
+        }
+        reset();
+    }
+
+    //decode the next samples chunk of a selected stream; false at the end of the file
+    bool readChunk()
+    {
+        while (!atEnd)
+        {
+            uint64_t length = readLength(file);
+            if (length < 2 || !file)
+            {
+                atEnd = true;
+                break;
+            }
+            uint16_t tag = readBin<uint16_t>(file);
+            if (tag == 3 && length >= 6)
+            {
+                ReaderStream& stream = streams[streamIndex(readBin<uint32_t>(file))];
+                if (stream.selected && stream.stream.info.channel_count > 0)
+                {
+                    chunk.resize(length - 6);
+                    file.read(chunk.data(), chunk.size());
+                    decodeSamples(stream, chunk.data(), chunk.data() + chunk.size());
+                    return true;
+                }
+                file.seekg(length - 6, std::ios::cur);
+            }
+            else
+                file.seekg(length - 2, std::ios::cur);
+        }
+        return false;
+    }
+
+    void decodeSamples(ReaderStream& stream, const char* p, const char* end)
+    {
+        const auto& info = stream.stream.info;
+        const bool isString = info.channel_format.compare("string") == 0;
+        const size_t valueBytes = (size_t)info.channel_count * Xdf::formatSize(info.channel_format);
+        if (!isString && valueBytes == 0)
+            return;
+
+        uint64_t numSamp;
+        if (!readLength(p, end, numSamp))
+            return;
+        for (uint64_t i = 0; i < numSamp && p < end; i++)
+        {
+            double ts;
+            if (*p++ == 8)
+            {
+                if (p + 8 > end)
+                    return;
+                std::memcpy(&ts, p, 8);
+                p += 8;
+                stream.anchor = ts;
+                stream.deduced = 0;
+            }
+            else if (info.nominal_srate > 0)
+                ts = stream.anchor + (double)(++stream.deduced) / info.nominal_srate;
+            else
+                ts = stream.last_timestamp;
+            stream.last_timestamp = ts;
+
+            if (isString)
+            {
+                for (auto& channel : stream.strings)
+                {
+                    uint64_t length;
+                    if (!readLength(p, end, length) || p + length > end)
+                        return;
+                    channel.emplace_back(p, length);
+                    p += length;
+                }
+            }
+            else
+            {
+                if (p + valueBytes > end)
+                    return;
+                switch (Xdf::formatSize(info.channel_format))
+                {
+                case 1: appendValues<int8_t>(p, stream.values); break;
+                case 2: appendValues<int16_t>(p, stream.values); break;
+                case 4:
+                    if (info.channel_format.compare("float32") == 0)
+                        appendValues<float>(p, stream.values);
+                    else
+                        appendValues<int32_t>(p, stream.values);
+                    break;
+                default:
+                    if (info.channel_format.compare("double64") == 0)
+                        appendValues<double>(p, stream.values);
+                    else
+                        appendValues<int64_t>(p, stream.values);
+                }
+                p += valueBytes;
+            }
+            stream.time_stamps.push_back(sync(stream, ts));
+        }
+    }
+
+    //time stamp plus the clock offset interpolated at it, held constant past the ends
+    double sync(ReaderStream& stream, double t)
+    {
+        const auto& times = stream.stream.clock_times;
+        const auto& values = stream.stream.clock_values;
+        if (times.empty())
+            return t;
+        if (times.size() == 1 || t <= times.front())
+            return t + values.front();
+        if (t >= times.back())
+            return t + values.back();
+
+        //time stamps mostly increase, so the interval is searched from the last one
+        size_t& j = stream.offset;
+        if (j + 1 >= times.size() || t < times[j])
+            j = std::upper_bound(times.begin(), times.end(), t) - times.begin() - 1;
+        while (t >= times[j + 1])
+            j++;
+        double slope = (values[j + 1] - values[j]) / (times[j + 1] - times[j]);
+        return t + values[j] + slope * (t - times[j]);
+    }
+
+    //the first n buffered samples as a matrix plus time stamps, removed from the buffers
+    Rcpp::List emit(ReaderStream& stream, int n)
+    {
+        const auto& info = stream.stream.info;
+        const size_t m = std::min(stream.time_stamps.size(), (size_t)n);
+        const int channels = info.channel_count;
+
+        if (stream.names.empty())
+        {
+            const Xdf::ChannelTable& table = Xdf::channelInfo(stream.stream);
+            auto label = std::find(table.keys.begin(), table.keys.end(), "label");
+            Rcpp::CharacterVector labels(channels);
+            for (int v = 0; v < channels; v++)
+                labels[v] = "V" + std::to_string(v + 1);
+            if (label != table.keys.end() && table.size() == (size_t)channels)
+            {
+                size_t k = label - table.keys.begin();
+                for (int v = 0; v < channels; v++)
+                    labels[v] = table.values[k][v];
+                labels = make_clean_names(labels);
+            }
+            stream.names = Rcpp::as<std::vector<std::string>>(labels);
+        }
+
+        Rcpp::RObject series;
+        if (info.channel_format.compare("string") == 0)
+        {
+            Rcpp::CharacterMatrix matrix(m, channels);
+            for (int v = 0; v < channels; v++)
+            {
+                for (size_t i = 0; i < m; i++)
+                    matrix(i, v) = stream.strings[v][i];
+                stream.strings[v].erase(stream.strings[v].begin(), stream.strings[v].begin() + m);
+            }
+            series = matrix;
+        }
+        else if (info.channel_format.compare("float32") == 0 || info.channel_format.compare("double64") == 0)
+        {
+            Rcpp::NumericMatrix matrix(m, channels);
+            for (int v = 0; v < channels; v++)
+            {
+                std::copy(stream.values[v].begin(), stream.values[v].begin() + m, matrix.column(v).begin());
+                stream.values[v].erase(stream.values[v].begin(), stream.values[v].begin() + m);
+            }
+            series = matrix;
+        }
+        else
+        {
+            // int64 values that do not fit an R integer become NA
+            Rcpp::IntegerMatrix matrix(m, channels);
+            for (int v = 0; v < channels; v++)
+            {
+                std::transform(stream.values[v].begin(), stream.values[v].begin() + m, matrix.column(v).begin(),
+                               to_integer);
+                stream.values[v].erase(stream.values[v].begin(), stream.values[v].begin() + m);
+            }
+            series = matrix;
+        }
+        series.attr("dimnames") = Rcpp::List::create(R_NilValue, Rcpp::wrap(stream.names));
+
+        Rcpp::NumericVector time_stamps(stream.time_stamps.begin(), stream.time_stamps.begin() + m);
+        stream.time_stamps.erase(stream.time_stamps.begin(), stream.time_stamps.begin() + m);
+
+        return Rcpp::List::create(
+            Rcpp::Named("time_series") = series,
+            Rcpp::Named("time_stamps") = time_stamps
+        );
+    }
+
+    std::string filename;
+    std::ifstream file;
+    std::streampos dataStart;
+    bool atEnd = false;
+    std::vector<ReaderStream> streams;
+    std::unordered_map<uint32_t, size_t> indices;   //stream id to position in streams
+    std::vector<char> chunk;                        //reused for every samples chunk
+};
+
+RCPP_MODULE(xdf_reader){
+    using namespace Rcpp ;
+
+    // the class is exposed as "xdf_reader" on the R side
+    class_<XdfReader>("xdf_reader")
+
+    // all streams, or the streams at these 1-based positions, as in load_xdf()
+    .constructor<std::string>()
+    .constructor<std::string, IntegerVector>()
+
+    // `next` is a reserved word in R, hence read_next
+    .method( "read_next", &XdfReader::readNext )
+    .method( "reset",     &XdfReader::reset )
+
+    .property( "done",    &XdfReader::done )
+    .property( "streams", &XdfReader::streamTable )
+    ;
+}